@@ -24,54 +24,38 @@
 #include "FIFO.h"
 #include "os.h"
 
-// Two-pointer implementation of the receive FIFO
-// can hold 0 to RXFIFOSIZE-1 elements
+// Joystick FIFO, Producer (Timer1A) puts and Consumer gets
+// JsFifoAvailable counts the elements so Consumer can block
 
-jsDataType volatile *JsPutPt; // put next
-jsDataType volatile *JsGetPt; // get next
-jsDataType static JsFifo[JSFIFOSIZE];
+AddRing(Js, JSFIFOSIZE, jsDataType)
 Sema4Type JsFifoAvailable;
 
-// initialize pointer FIFO
+// initialize joystick FIFO
 void JsFifo_Init(void){ long sr;
   sr = StartCritical();      // make atomic
 	OS_InitSemaphore(&JsFifoAvailable, 0);
-  JsPutPt = JsGetPt = &JsFifo[0]; // Empty
+	OS_NameSemaphore(&JsFifoAvailable, "JsFifoAvailable");
+  JsRing_Init();             // Empty
   EndCritical(sr);
 }
-// add element to end of pointer FIFO
-// return RXFIFOSUCCESS if successful
+// add element to end of joystick FIFO
+// return JSFIFOSUCCESS if successful
 int JsFifo_Put(jsDataType data){
-  jsDataType volatile *nextPutPt;
-  nextPutPt = JsPutPt+1;
-  if(nextPutPt == &JsFifo[JSFIFOSIZE]){
-    nextPutPt = &JsFifo[0];  // wrap
-  }
-  if(nextPutPt == JsGetPt){
+  if(JsRing_Put(data) == RINGFAIL){
     return(JSFIFOFAIL);      // Failed, fifo full
   }
-  else{
-    *(JsPutPt) = data;       // Put
-    JsPutPt = nextPutPt;     // Success, update
-		OS_Signal(&JsFifoAvailable);
-    return(JSFIFOSUCCESS);
-  }
+	OS_Signal(&JsFifoAvailable);
+  return(JSFIFOSUCCESS);
 }
-// remove element from front of pointer FIFO
-// return RXFIFOSUCCESS if successful
+// remove element from front of joystick FIFO, wait while it is empty
+// return JSFIFOSUCCESS if successful
 int JsFifo_Get(jsDataType *datapt){
   OS_Wait(&JsFifoAvailable);
-  *datapt = *(JsGetPt++);
-  if(JsGetPt == &JsFifo[JSFIFOSIZE]){
-     JsGetPt = &JsFifo[0];   // wrap
-  }
+  JsRing_Get(datapt);        // the semaphore says there is one
   return(JSFIFOSUCCESS);
 }
-// number of elements in pointer FIFO
-// 0 to RXFIFOSIZE-1
+// number of elements in joystick FIFO
+// 0 to JSFIFOSIZE
 uint32_t JsFifo_Size(void){
-  if(JsPutPt < JsGetPt){
-    return ((uint32_t)(JsPutPt-JsGetPt+(JSFIFOSIZE*sizeof(jsDataType)))/sizeof(jsDataType));
-  }
-  return ((uint32_t)(JsPutPt-JsGetPt)/sizeof(jsDataType));
+  return(JsRing_Size());
 }
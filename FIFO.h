@@ -27,13 +27,14 @@
 
 #ifndef __FIFO_H__
 #define __FIFO_H__
+#include <stdint.h>
 
 long StartCritical (void);    // previous I bit, disable interrupts
 void EndCritical(long sr);    // restore I bit to previous value
 
-// Two-pointer implementation of the receive FIFO
-// can hold 0 to RXFIFOSIZE-1 elements
-#define JSFIFOSIZE 16 // can be any size
+// Joystick FIFO, a ring from AddRing below with a semaphore to block on
+// can hold 0 to JSFIFOSIZE elements
+#define JSFIFOSIZE 16 // must be a power of 2
 #define JSFIFOSUCCESS 1
 #define JSFIFOFAIL    0
 
@@ -50,7 +51,58 @@ int JsFifo_Put(jsDataType data);
 // return RXFIFOSUCCESS if successful
 int JsFifo_Get(jsDataType *datapt);
 // number of elements in pointer FIFO
-// 0 to RXFIFOSIZE-1
+// 0 to JSFIFOSIZE
 uint32_t JsFifo_Size(void);
 
+// Single producer, single consumer ring
+// AddRing(NAME,SIZE,TYPE) creates NAMERing_Init, NAMERing_Put, NAMERing_Get
+// and NAMERing_Size for a ring of SIZE elements of TYPE, SIZE a power of 2.
+// The put and get indexes run freely and are masked on use, so the ring
+// holds all SIZE elements and the size is just their difference. Each index
+// is written by one side only: Put may run in one thread or ISR and Get in
+// another without disabling interrupts. RINGBARRIER orders the element copy
+// before the index that hands it over.
+// Put and Get return RINGSUCCESS or RINGFAIL (full or empty), never block.
+#define RINGSUCCESS 1
+#define RINGFAIL    0
+#ifdef __ARMCC_VERSION
+#define RINGBARRIER() __dmb(0xF)
+#else
+#define RINGBARRIER() __sync_synchronize()
+#endif
+
+#define AddRing(NAME,SIZE,TYPE) \
+typedef char NAME ## RingSizeCheck[(((SIZE)&((SIZE)-1)) == 0) ? 1 : -1]; \
+static TYPE NAME ## Ring[SIZE]; \
+static uint32_t volatile NAME ## PutI; \
+static uint32_t volatile NAME ## GetI; \
+static __inline void NAME ## Ring_Init(void){ \
+  NAME ## PutI = NAME ## GetI = 0; \
+} \
+static __inline int NAME ## Ring_Put(TYPE data){ \
+  uint32_t putI = NAME ## PutI; \
+  if((putI - NAME ## GetI) >= (SIZE)){ \
+    return(RINGFAIL); \
+  } \
+  RINGBARRIER(); \
+  NAME ## Ring[putI&((SIZE)-1)] = data; \
+  RINGBARRIER(); \
+  NAME ## PutI = putI + 1; \
+  return(RINGSUCCESS); \
+} \
+static __inline int NAME ## Ring_Get(TYPE *datapt){ \
+  uint32_t getI = NAME ## GetI; \
+  if(getI == NAME ## PutI){ \
+    return(RINGFAIL); \
+  } \
+  RINGBARRIER(); \
+  *datapt = NAME ## Ring[getI&((SIZE)-1)]; \
+  RINGBARRIER(); \
+  NAME ## GetI = getI + 1; \
+  return(RINGSUCCESS); \
+} \
+static __inline uint32_t NAME ## Ring_Size(void){ \
+  return(NAME ## PutI - NAME ## GetI); \
+}
+
 #endif //  __FIFO_H__
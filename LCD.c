@@ -1421,9 +1421,10 @@ void BSP_LCD_PlotIncrement(void){
   BSP_LCD_DrawFastVLine(TimeIndex + 11, 17, 100, PlotBGColor);
 }
 
-Sema4Type LCDFree;
+MutexType LCDFree;
 void BSP_LCD_OutputInit(void){
-	OS_InitSemaphore(&LCDFree, 1);
+	OS_InitMutex(&LCDFree);
+	OS_NameMutex(&LCDFree, "LCDFree");
 	BSP_LCD_Init();
 	BSP_LCD_FillScreen(ST7735_BLACK);
 }
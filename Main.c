@@ -18,6 +18,7 @@
 #include "FIFO.h"
 #include "joystick.h"
 #include "PORTE.h"
+#include "trace.h"
 
 // Constants
 #define BGCOLOR     					LCD_BLACK
@@ -33,6 +34,22 @@
 #define CUBESIZE 17
 #define XGRIDSIZE 102
 #define YGRIDSIZE 102
+#define CUBEPOOL             	// run each cube as a thread pool job instead of its own thread
+#define CUBEEVENTS           	// CubeSpawner waits on GameEvents instead of polling CubeArray
+#define CUBES_DEAD           	0x00000001 // GameEvents flag, the last cube of a wave is done
+#define TRACEDRAIN           	// send the kernel trace out UART0 from a low priority thread
+//#define WHEELTEST            	// add 16 periodic tasks at different rates to check the timer wheel
+//#define DEADLINETEST         	// add deadline threads to check edfSched or rmSched in os.c
+//#define RINGBENCH            	// time the AddRing put and get before launch, results in RingBench*
+//#define MSGBENCH             	// measure message queue throughput and latency, results in MsgBench*
+//#define NOTIFYBENCH          	// ping-pong round trip of OS_Signal/OS_Wait against OS_Notify/OS_NotifyWait, results in NotifyBench*
+//#define POOLBENCH            	// time OS_PoolAlloc/OS_PoolFree against a static array before launch, results in PoolBench*
+//#define AGINGTEST            	// a priority 5 thread under a priority 1 hog, results in Aging*
+//#define THREADSTRESS         	// threads add and kill each other at random, checks the thread ring, results in Stress*
+//#define SEMASTRESS           	// waiters of mixed priority queue on one semaphore, checks the wake order, results in SemaStress*
+//#define SCHEDBENCH           	// switch latency with 5, 10 and 20 live threads instead of the game, results in SchedBench*
+//#define CRITDUMP             	// SW1 sends the critProfile results (critical.h) out UART0, turn TRACEDRAIN off or the text lands in the trace stream
+//#define LOCKSTATS            	// rank locks by wait time over 30 s of play (semaStats in os.h), results in LockRank, turn TRACEDRAIN off or the text lands in the trace stream
 
 uint16_t EXPIRATIONTIME_MS = 5000;
 uint16_t CUBEMOVETIME_MS = 100;
@@ -43,6 +60,7 @@ typedef struct {
  Sema4Type BlockFree;
 } block;
 block BlockArray[HORIZONTALNUM][VERTICALNUM];
+char BlockFreeName[HORIZONTALNUM][VERTICALNUM][12]; // "BlockFree" and the two indexes, for OS_NameSemaphore
 
 typedef struct {
  //position is the location in the 6x6 grid of blocks. Takes on values from 0-5
@@ -56,9 +74,25 @@ typedef struct {
  Sema4Type CubeFree;
 } cube;
 cube CubeArray[NUMCUBES];
+char CubeFreeName[NUMCUBES][11];  // "CubeFree" and the index, for OS_NameSemaphore
 
-extern Sema4Type LCDFree;
+// ******** IndexName ************
+// copy base to name followed by two index digits, 0 to 9 each
+// gives the semaphores of an array their own names in OS_NextLock
+void IndexName(char *name, const char *base, uint8_t first, uint8_t second){
+	while (*base){
+		*name++ = *base++;
+	}
+	*name++ = '0' + first;
+	*name++ = '0' + second;
+	*name = 0;
+}
+
+extern MutexType LCDFree;
 Sema4Type scoreFree, lifeFree;
+Sema4Type cubesLeftFree;
+EventFlagsType GameEvents;
+uint8_t CubesLeft;   // cubes of the current wave that have not finished
 uint16_t origin[2]; 	// The original ADC value of x,y if the joystick is not touched, used as reference
 int16_t x = 63;  			// horizontal position of the crosshair, initially 63
 int16_t y = 63;  			// vertical position of the crosshair, initially 63
@@ -72,7 +106,9 @@ bool spawner_active = false;
 bool game_started = false;
 uint16_t high_score = 0;
 
-unsigned long NumCreated;   		// Number of foreground threads created
+unsigned long NumCreated;   		// Number of foreground threads created, pool workers not included
+unsigned long NumWorkers;   		// Number of thread pool workers created (CUBEPOOL)
+unsigned long NumJobs;      		// Number of cube jobs given to the thread pool (CUBEPOOL)
 unsigned long NumSamples;   		// Incremented every ADC sample, in Producer
 unsigned long UpdateWork;   		// Incremented every update on position values
 unsigned long Calculation;  		// Incremented every cube number calculation
@@ -91,6 +127,11 @@ unsigned long const JitterSize=JITTERSIZE;
 unsigned long JitterHistogram[JITTERSIZE]={0,};
 unsigned long TotalWithI1;
 unsigned short MaxWithI1;
+unsigned long WaveStartTime;    // time stamp for when CubeSpawner started a wave
+unsigned long SpawnMaxTime;     // longest time from the start of a wave until a cube runs, 12.5ns units
+unsigned long SpawnTotalTime;   // sum of those times in 12.5ns units
+unsigned long SpawnCount;       // number of cubes that started running
+unsigned long SpawnerPasses;    // times CubeSpawner woke up to check whether a wave is over
 
 void Device_Init(void){
 	UART_Init();
@@ -202,6 +243,652 @@ void Producer(void){
 
 //--------------end of Task 1-----------------------------
 
+#ifdef WHEELTEST
+//------------------Timer wheel test--------------------------------
+// 16 background tasks with periods from 0.5ms to 8ms, first calls spread one
+// tick apart and priorities 0 to 3. Each keeps its call count and its worst
+// jitter in 0.1us like Producer, so both can be read in the debugger.
+#define WHEELTASKS 16
+TimerType WheelTimers[WHEELTASKS];
+unsigned long WheelCount[WHEELTASKS];       // calls of each task
+unsigned long WheelMaxJitter[WHEELTASKS];   // worst jitter of each task in 0.1us
+unsigned long WheelLast[WHEELTASKS];        // OS_Time() of the previous call
+unsigned long WheelAddFails;                // timers that could not be started
+
+void WheelRecord(int n){
+	unsigned long thisTime = OS_Time();
+	unsigned long period = WheelTimers[n].Period*OS_TIMERTICK;
+	unsigned long diff, jitter;
+	if (WheelCount[n]){
+		diff = OS_TimeDifference(WheelLast[n], thisTime);
+		if (diff > period){
+			jitter = (diff-period+4)/8;
+		}
+		else{
+			jitter = (period-diff+4)/8;
+		}
+		if (jitter > WheelMaxJitter[n]){
+			WheelMaxJitter[n] = jitter;
+		}
+	}
+	WheelLast[n] = thisTime;
+	WheelCount[n]++;
+}
+
+#define WHEELTASK(n) void WheelTask##n(void){ WheelRecord(n); }
+WHEELTASK(0)  WHEELTASK(1)  WHEELTASK(2)  WHEELTASK(3)
+WHEELTASK(4)  WHEELTASK(5)  WHEELTASK(6)  WHEELTASK(7)
+WHEELTASK(8)  WHEELTASK(9)  WHEELTASK(10) WHEELTASK(11)
+WHEELTASK(12) WHEELTASK(13) WHEELTASK(14) WHEELTASK(15)
+void (* const WheelTasks[WHEELTASKS])(void) = {
+	WheelTask0,  WheelTask1,  WheelTask2,  WheelTask3,
+	WheelTask4,  WheelTask5,  WheelTask6,  WheelTask7,
+	WheelTask8,  WheelTask9,  WheelTask10, WheelTask11,
+	WheelTask12, WheelTask13, WheelTask14, WheelTask15
+};
+
+void WheelTest_Init(void){
+	int n;
+	for (n = 0; n < WHEELTASKS; n++){
+		if (OS_AddTimer(&WheelTimers[n], WheelTasks[n], n*OS_TIMERTICK, (n+1)*TIME_500US, n%4) == 0){
+			WheelAddFails++;
+		}
+	}
+}
+#endif
+
+#ifdef DEADLINETEST
+//------------------Deadline thread test--------------------------------
+// Three deadline threads busy wait for a fixed time each period, 60% of the
+// CPU together. Each asks for 0.5ms more than it uses, 77.5% in all, which
+// passes both the EDF test and the rate monotonic bound for 3 threads (78%).
+// A fourth asking for another 50% must be refused. Jobs and misses are read
+// with OS_GetThreadStats or in the debugger.
+#define DEADLINETASKS 3
+const unsigned long DeadlinePeriod[DEADLINETASKS] = {5*TIME_1MS, 10*TIME_1MS, 20*TIME_1MS};
+const unsigned long DeadlineWork[DEADLINETASKS] = {TIME_1MS, 2*TIME_1MS, 4*TIME_1MS};
+unsigned long DeadlineJobs[DEADLINETASKS];  // jobs finished by each thread
+unsigned long DeadlineAdded;                // threads admitted
+unsigned long DeadlineRejected;             // threads refused, 1 if admission works
+
+void DeadlineLoop(int n){
+	unsigned long start;
+	while(1){
+		start = OS_Time();
+		while (OS_TimeDifference(start, OS_Time()) < DeadlineWork[n]){
+		}
+		DeadlineJobs[n]++;
+		OS_WaitPeriod();
+	}
+}
+void DeadlineTask0(void){ DeadlineLoop(0); }
+void DeadlineTask1(void){ DeadlineLoop(1); }
+void DeadlineTask2(void){ DeadlineLoop(2); }
+void (* const DeadlineTasks[DEADLINETASKS])(void) = {
+	DeadlineTask0, DeadlineTask1, DeadlineTask2
+};
+
+void DeadlineTest_Init(void){
+	int n;
+	for (n = 0; n < DEADLINETASKS; n++){
+		DeadlineAdded += OS_AddDeadlineThread(DeadlineTasks[n], 256, DeadlinePeriod[n], DeadlineWork[n]+TIME_500US);
+	}
+	if (OS_AddDeadlineThread(&DeadlineTask0, 256, 2*TIME_1MS, TIME_1MS) == 0){
+		DeadlineRejected++;
+	}
+}
+#endif
+
+#ifdef RINGBENCH
+//------------------Ring benchmark--------------------------------
+// Runs once from main with interrupts disabled. Times RINGBENCHOPS puts and
+// gets of a 16 word ring, and the same with each call inside
+// StartCritical/EndCritical like the old FIFOs. OS_Time() counts bus
+// cycles, so the results are average cycles per call.
+#define RINGBENCHOPS 1024
+AddRing(Bench, 16, uint32_t)
+unsigned long RingBenchPut;        // cycles per Put
+unsigned long RingBenchGet;        // cycles per Get
+unsigned long RingBenchLockedPut;  // cycles per Put inside a critical section
+unsigned long RingBenchLockedGet;  // cycles per Get inside a critical section
+
+void RingBench(void){
+	unsigned long start, put = 0, get = 0, lockedPut = 0, lockedGet = 0;
+	uint32_t data;
+	long sr;
+	int i, j;
+	BenchRing_Init();
+	for (i = 0; i < RINGBENCHOPS/16; i++){
+		start = OS_Time();
+		for (j = 0; j < 16; j++){
+			BenchRing_Put(j);
+		}
+		put += OS_TimeDifference(start, OS_Time());
+		start = OS_Time();
+		for (j = 0; j < 16; j++){
+			BenchRing_Get(&data);
+		}
+		get += OS_TimeDifference(start, OS_Time());
+		start = OS_Time();
+		for (j = 0; j < 16; j++){
+			sr = StartCritical();
+			BenchRing_Put(j);
+			EndCritical(sr);
+		}
+		lockedPut += OS_TimeDifference(start, OS_Time());
+		start = OS_Time();
+		for (j = 0; j < 16; j++){
+			sr = StartCritical();
+			BenchRing_Get(&data);
+			EndCritical(sr);
+		}
+		lockedGet += OS_TimeDifference(start, OS_Time());
+	}
+	RingBenchPut = put/RINGBENCHOPS;
+	RingBenchGet = get/RINGBENCHOPS;
+	RingBenchLockedPut = lockedPut/RINGBENCHOPS;
+	RingBenchLockedGet = lockedGet/RINGBENCHOPS;
+}
+#endif
+
+#ifdef POOLBENCH
+//------------------Memory pool benchmark--------------------------------
+// Runs once from main with interrupts disabled. With 3/4 of the blocks
+// taken, times POOLBENCHOPS allocations and frees from an OS_InitPool pool
+// and from the usual static array with an in-use flag per slot, searched
+// inside StartCritical/EndCritical so it is as ISR safe as the pool. The
+// results are average cycles per call.
+#define POOLBENCHOPS 1024
+#define POOLBENCHBLOCKS 32
+#define POOLBENCHSIZE 16            // bytes per block
+MemPoolType BenchPool;
+uint32_t BenchPoolBuffer[POOLBENCHBLOCKS*POOLBENCHSIZE/4];
+struct benchSlot{
+	uint8_t Used;
+	uint8_t Data[POOLBENCHSIZE];
+};
+struct benchSlot BenchArray[POOLBENCHBLOCKS];
+unsigned long PoolBenchAlloc;       // cycles per OS_PoolAlloc
+unsigned long PoolBenchFree;        // cycles per OS_PoolFree
+unsigned long PoolBenchArrayAlloc;  // cycles per static array allocation
+unsigned long PoolBenchArrayFree;   // cycles per static array free
+
+void *BenchArrayAlloc(void){
+	int i;
+	long sr = StartCritical();
+	for (i = 0; i < POOLBENCHBLOCKS; i++){
+		if (BenchArray[i].Used == 0){
+			BenchArray[i].Used = 1;
+			EndCritical(sr);
+			return BenchArray[i].Data;
+		}
+	}
+	EndCritical(sr);
+	return 0;
+}
+
+void BenchArrayFree(void *data){
+	int i = ((uint8_t *)data - BenchArray[0].Data)/sizeof(struct benchSlot);
+	long sr = StartCritical();
+	BenchArray[i].Used = 0;
+	EndCritical(sr);
+}
+
+void PoolBench(void){
+	unsigned long start, alloc = 0, free = 0, arrayAlloc = 0, arrayFree = 0;
+	void *blocks[8];
+	int i, j;
+	OS_InitPool(&BenchPool, BenchPoolBuffer, POOLBENCHSIZE, POOLBENCHBLOCKS);
+	for (i = 0; i < POOLBENCHBLOCKS*3/4; i++){ // what the game would already hold
+		OS_PoolAlloc(&BenchPool, OS_NO_WAIT);
+		BenchArrayAlloc();
+	}
+	for (i = 0; i < POOLBENCHOPS/8; i++){
+		start = OS_Time();
+		for (j = 0; j < 8; j++){
+			blocks[j] = OS_PoolAlloc(&BenchPool, OS_NO_WAIT);
+		}
+		alloc += OS_TimeDifference(start, OS_Time());
+		start = OS_Time();
+		for (j = 0; j < 8; j++){
+			OS_PoolFree(&BenchPool, blocks[j]);
+		}
+		free += OS_TimeDifference(start, OS_Time());
+		start = OS_Time();
+		for (j = 0; j < 8; j++){
+			blocks[j] = BenchArrayAlloc();
+		}
+		arrayAlloc += OS_TimeDifference(start, OS_Time());
+		start = OS_Time();
+		for (j = 0; j < 8; j++){
+			BenchArrayFree(blocks[j]);
+		}
+		arrayFree += OS_TimeDifference(start, OS_Time());
+	}
+	PoolBenchAlloc = alloc/POOLBENCHOPS;
+	PoolBenchFree = free/POOLBENCHOPS;
+	PoolBenchArrayAlloc = arrayAlloc/POOLBENCHOPS;
+	PoolBenchArrayFree = arrayFree/POOLBENCHOPS;
+}
+#endif
+
+#ifdef MSGBENCH
+//------------------Message queue benchmark--------------------------------
+// MsgBenchReceiver takes MSGBENCHCOUNT time stamped messages from one sender
+// thread (phase 0), then from MSGBENCHSENDERS of them (phase 1). Latency is
+// from OS_MsgSend to the return of OS_MsgReceive, in bus cycles; the rate is
+// messages per second. The receiver outranks the senders, so in phase 0
+// every message is handed straight to it.
+#define MSGBENCHSENDERS 4
+#define MSGBENCHCOUNT 1000   // messages per phase
+#define MSGBENCHDEPTH 8
+typedef struct {
+	unsigned long Time;        // OS_Time() just before OS_MsgSend
+	unsigned long Sender;      // thread ID
+} benchMsgType;
+benchMsgType MsgBenchBuffer[MSGBENCHDEPTH];
+MsgQueueType MsgBenchQueue;
+unsigned long MsgBenchPhase;          // phase running, 2 when done
+unsigned long MsgBenchSenders;        // sender threads alive
+bool MsgBenchStop;                    // tells the senders to quit
+unsigned long MsgBenchRate[2];        // messages per second
+unsigned long MsgBenchMaxLatency[2];  // bus cycles
+unsigned long MsgBenchAvgLatency[2];  // bus cycles
+
+void MsgBenchSender(void){
+	benchMsgType msg;
+	while (!MsgBenchStop){
+		msg.Sender = OS_Id();
+		msg.Time = OS_Time();
+		OS_MsgSend(&MsgBenchQueue, &msg, OS_WAIT_FOREVER);
+	}
+	MsgBenchSenders--;
+	OS_Kill();
+}
+
+void MsgBenchReceiver(void){
+	benchMsgType msg;
+	unsigned long start, latency, total, n;
+	int i, phase;
+	for (phase = 0; phase < 2; phase++){
+		MsgBenchStop = false;
+		for (i = 0; i < (phase ? MSGBENCHSENDERS : 1); i++){
+			MsgBenchSenders += OS_AddThread(&MsgBenchSender, 256, 3);
+		}
+		total = 0;
+		start = OS_Time();
+		for (n = 0; n < MSGBENCHCOUNT; n++){
+			OS_MsgReceive(&MsgBenchQueue, &msg, OS_WAIT_FOREVER);
+			latency = OS_TimeDifference(msg.Time, OS_Time());
+			total += latency;
+			if (latency > MsgBenchMaxLatency[phase]){
+				MsgBenchMaxLatency[phase] = latency;
+			}
+		}
+		MsgBenchRate[phase] = (unsigned long)((uint64_t)MSGBENCHCOUNT*1000*TIME_1MS/OS_TimeDifference(start, OS_Time()));
+		MsgBenchAvgLatency[phase] = total/MSGBENCHCOUNT;
+		MsgBenchStop = true;
+		while (MsgBenchSenders){ // take what they still send until they have quit
+			OS_MsgReceive(&MsgBenchQueue, &msg, 2);
+		}
+		MsgBenchPhase++;
+	}
+	OS_Kill();
+}
+
+void MsgBench_Init(void){
+	OS_InitMsgQueue(&MsgBenchQueue, MsgBenchBuffer, sizeof(benchMsgType), MSGBENCHDEPTH);
+	OS_AddThread(&MsgBenchReceiver, 256, 2);
+}
+#endif
+
+#ifdef NOTIFYBENCH
+//------------------Notification benchmark--------------------------------
+// NotifyBenchPing wakes NotifyBenchPong and waits for its answer, with two
+// semaphores in phase 0 and with thread notifications in phase 1. Pong
+// outranks ping, so each round trip is two direct switches. Times are
+// from the signal to the return of the wait for the answer, in bus cycles.
+#define NOTIFYBENCHCOUNT 1000  // round trips per phase
+#define NOTIFYBENCHBIT 0x01
+Sema4Type NotifyBenchPingSema, NotifyBenchPongSema;
+unsigned long NotifyBenchPingId, NotifyBenchPongId;
+unsigned long NotifyBenchPhase;        // phase running, 2 when done
+unsigned long NotifyBenchMax[2];       // bus cycles
+unsigned long NotifyBenchAvg[2];       // bus cycles
+
+void NotifyBenchPong(void){
+	unsigned long n;
+	NotifyBenchPongId = OS_Id();
+	for (n = 0; n < NOTIFYBENCHCOUNT; n++){
+		OS_Wait(&NotifyBenchPingSema);
+		OS_Signal(&NotifyBenchPongSema);
+	}
+	for (n = 0; n < NOTIFYBENCHCOUNT; n++){
+		OS_NotifyWait(NOTIFYBENCHBIT, OS_WAIT_FOREVER);
+		OS_Notify(NotifyBenchPingId, NOTIFYBENCHBIT);
+	}
+	OS_Kill();
+}
+
+void NotifyBenchPing(void){
+	unsigned long start, trip, total, n;
+	int phase;
+	NotifyBenchPingId = OS_Id();
+	for (phase = 0; phase < 2; phase++){
+		total = 0;
+		for (n = 0; n < NOTIFYBENCHCOUNT; n++){
+			start = OS_Time();
+			if (phase == 0){
+				OS_Signal(&NotifyBenchPingSema);
+				OS_Wait(&NotifyBenchPongSema);
+			}
+			else{
+				OS_Notify(NotifyBenchPongId, NOTIFYBENCHBIT);
+				OS_NotifyWait(NOTIFYBENCHBIT, OS_WAIT_FOREVER);
+			}
+			trip = OS_TimeDifference(start, OS_Time());
+			total += trip;
+			if (trip > NotifyBenchMax[phase]){
+				NotifyBenchMax[phase] = trip;
+			}
+		}
+		NotifyBenchAvg[phase] = total/NOTIFYBENCHCOUNT;
+		NotifyBenchPhase++;
+	}
+	OS_Kill();
+}
+
+void NotifyBench_Init(void){
+	OS_InitSemaphore(&NotifyBenchPingSema, 0);
+	OS_InitSemaphore(&NotifyBenchPongSema, 0);
+	OS_AddThread(&NotifyBenchPong, 256, 2);
+	OS_AddThread(&NotifyBenchPing, 256, 3);
+}
+#endif
+
+#ifdef AGINGTEST
+//------------------Aging starvation test--------------------------------
+// AgingHog never blocks for AGINGTESTMS, so without aging nothing below
+// priority 1 would run. AgingVictim at priority 5 gains a level every 9 ms
+// it is kept waiting. After 4*9 ms it reaches the hog's level and shares the
+// time slices there, after 9 ms more it reaches 0 and runs at the next
+// switch. Every gap between two runs must stay under AGINGBOUND, so
+// AgingFails must be 0 once AgingDone is 1.
+#define AGINGTESTMS 2000
+#define AGINGBOUND ((4*9 + 9 + 2)*TIME_1MS) // 12.5ns units, 4 levels, 9 ms of slices, one 2 ms slice
+unsigned long AgingTestRuns;     // times AgingVictim got the CPU
+unsigned long AgingMaxStarve;    // longest wait for the CPU, 12.5ns units
+unsigned long AgingFails;        // waits longer than AGINGBOUND
+unsigned long AgingDone;         // 1 once AgingVictim has stopped
+unsigned long AgingHogLoops;
+uint64_t AgingEnd;               // OS_Time64() when the hog stops, 0 until it starts
+
+void AgingHog(void){
+	AgingEnd = OS_Time64() + (uint64_t)AGINGTESTMS*TIME_1MS;
+	while (OS_Time64() < AgingEnd){
+		AgingHogLoops++;
+	}
+	OS_Kill();
+}
+
+void AgingVictim(void){
+	unsigned long last, now;
+	last = OS_Time();
+	while ((AgingEnd == 0) || (OS_Time64() < AgingEnd)){
+		now = OS_Time();
+		if (OS_TimeDifference(last, now) > AgingMaxStarve){
+			AgingMaxStarve = OS_TimeDifference(last, now);
+		}
+		if (OS_TimeDifference(last, now) > AGINGBOUND){
+			AgingFails++;
+		}
+		last = now;
+		AgingTestRuns++;
+	}
+	AgingDone = 1;
+	OS_Kill(); // the game threads get the CPU back
+}
+
+void AgingTest_Init(void){
+	OS_AddThread(&AgingHog, 256, 1);
+	OS_AddThread(&AgingVictim, 256, 5);
+}
+#endif
+
+#ifdef THREADSTRESS
+//------------------Thread add and kill stress test--------------------------------
+// StressParent keeps adding StressChild threads with random stack sizes and
+// priorities until the TCBs or the stack arena run out. Each child yields
+// and sleeps a random number of times, sometimes adds another child and
+// then kills itself. OS_CheckThreads walks the thread ring and the free TCB
+// list after every add and before every kill; StressErrors must stay 0.
+unsigned long StressAdded;       // OS_AddThread calls that succeeded
+unsigned long StressFull;        // calls refused, no TCB or stack left
+unsigned long StressKilled;      // children that finished
+unsigned long StressErrors;      // times OS_CheckThreads found a broken ring
+unsigned long StressMaxLive;     // most threads alive at once
+uint32_t StressSeed = 1;
+
+// LCG, threads racing on StressSeed only change the sequence
+uint32_t StressRand(void){
+	StressSeed = StressSeed*1664525 + 1013904223;
+	return StressSeed >> 16;
+}
+
+void StressCheck(void){
+	long live = OS_CheckThreads();
+	if (live < 0){
+		StressErrors++;
+	}
+	else if (live > StressMaxLive){
+		StressMaxLive = live;
+	}
+}
+
+void StressChild(void);
+void StressAdd(void){
+	if (OS_AddThread(&StressChild, 128 + 8*(StressRand()%16), 2 + StressRand()%3)){
+		StressAdded++;
+	}
+	else{
+		StressFull++;
+	}
+	StressCheck();
+}
+
+void StressChild(void){
+	uint32_t n = StressRand()%8;
+	while (n--){
+		if (StressRand()&1){
+			OS_Suspend();
+		}
+		else{
+			OS_Sleep(StressRand()%4);
+		}
+	}
+	if ((StressRand()%4) == 0){
+		StressAdd();
+	}
+	StressCheck();
+	StressKilled++;
+	OS_Kill();
+}
+
+void StressParent(void){
+	while(1){
+		StressAdd();
+		OS_Sleep(1 + StressRand()%3);
+	}
+}
+
+void ThreadStress_Init(void){
+	OS_AddThread(&StressParent, 256, 2);
+}
+#endif
+
+#ifdef SEMASTRESS
+//------------------Semaphore wait queue stress test--------------------------------
+// Each round SemaStressMain adds SEMASTRESSWAITERS threads with random
+// priorities 2 to 5 that all block on SemaStressSema, then signals it once
+// per waiter and waits for the woken one to report before the next signal.
+// Waiters must come back highest priority first, and in the order they
+// blocked within a priority. Even rounds use OS_Wait/OS_Signal, odd rounds
+// OS_bWait/OS_bSignal. SemaStressErrors must stay 0.
+#define SEMASTRESSWAITERS 8
+#define SEMASTRESSROUNDS 50
+Sema4Type SemaStressSema;
+unsigned long SemaStressRound;       // round running, SEMASTRESSROUNDS when done
+unsigned long SemaStressBlocked;     // waiters that have queued this round
+unsigned long SemaStressWoken;       // waiters that have returned this round
+unsigned long SemaStressLastPri;     // priority of the last waiter to return
+unsigned long SemaStressLastSeq;     // queue position of the last waiter to return
+unsigned long SemaStressErrors;      // waiters that returned out of order
+unsigned long SemaStressAddFails;    // waiters that could not be added
+uint32_t SemaStressSeed = 1;
+
+#define SEMASTRESSWAITER(pri) void SemaStressWaiter##pri(void){ SemaStressWait(pri); }
+void SemaStressWait(unsigned long priority){
+	unsigned long seq;
+	long sr = StartCritical(); // OS_Wait queues us before interrupts come back on
+	seq = SemaStressBlocked++;
+	if (SemaStressRound&1){
+		OS_bWait(&SemaStressSema);
+	}
+	else{
+		OS_Wait(&SemaStressSema);
+	}
+	EndCritical(sr);
+	if (SemaStressWoken && ((priority < SemaStressLastPri) ||
+	    ((priority == SemaStressLastPri) && (seq < SemaStressLastSeq)))){
+		SemaStressErrors++;
+	}
+	SemaStressLastPri = priority;
+	SemaStressLastSeq = seq;
+	SemaStressWoken++;
+	OS_Kill();
+}
+SEMASTRESSWAITER(2) SEMASTRESSWAITER(3) SEMASTRESSWAITER(4) SEMASTRESSWAITER(5)
+void (* const SemaStressWaiters[4])(void) = {
+	SemaStressWaiter2, SemaStressWaiter3, SemaStressWaiter4, SemaStressWaiter5
+};
+
+void SemaStressMain(void){
+	unsigned long n, added, pri;
+	for (SemaStressRound = 0; SemaStressRound < SEMASTRESSROUNDS; SemaStressRound++){
+		OS_InitSemaphore(&SemaStressSema, 0);
+		SemaStressBlocked = 0;
+		SemaStressWoken = 0;
+		added = 0;
+		for (n = 0; n < SEMASTRESSWAITERS; n++){
+			SemaStressSeed = SemaStressSeed*1664525 + 1013904223;
+			pri = (SemaStressSeed >> 16)%4;
+			if (OS_AddThread(SemaStressWaiters[pri], 256, 2 + pri)){
+				added++;
+			}
+			else{
+				SemaStressAddFails++;
+			}
+		}
+		while (SemaStressBlocked < added){ // everyone queues before the first wakeup
+			OS_Sleep(1);
+		}
+		for (n = 0; n < added; n++){
+			if (SemaStressRound&1){
+				OS_bSignal(&SemaStressSema);
+			}
+			else{
+				OS_Signal(&SemaStressSema);
+			}
+			while (SemaStressWoken == n){
+				OS_Sleep(1);
+			}
+		}
+	}
+	OS_Kill();
+}
+
+void SemaStress_Init(void){
+	OS_InitSemaphore(&SemaStressSema, 0);
+	OS_NameSemaphore(&SemaStressSema, "SemaStressSema");
+	OS_AddThread(&SemaStressMain, 256, 1);
+}
+#endif
+
+#ifdef SCHEDBENCH
+//------------------Context switch benchmark--------------------------------
+// SchedBenchMain adds SchedBenchWorker threads until SchedBenchLive[phase]
+// threads are alive, counting itself and the idle thread. The workers share
+// one priority and only call OS_Suspend, so for SCHEDBENCHMS they hand the
+// CPU round robin to each other. Each one measures from the time stamp the
+// previous worker took just before OS_Suspend to its own return from it, the
+// whole switch through PendSV and Scheduler(), in bus cycles. The game
+// threads are not added so 20 threads fit in the TCBs. Comment out readyQueue
+// in os.c for the linear scan figures, and turn on schedulerProfile for the
+// time of Scheduler() alone (SchedMaxTime, indexed by live threads).
+#define SCHEDBENCHPHASES 3
+#define SCHEDBENCHMS 1000               // ms of switching per phase
+const unsigned long SchedBenchLive[SCHEDBENCHPHASES] = {5, 10, 20};
+unsigned long SchedBenchPhase;                  // phase running, 3 when done
+unsigned long SchedBenchWorkers;                // workers alive
+unsigned long SchedBenchAddFails;               // workers that could not be added
+unsigned long SchedBenchSwitches[SCHEDBENCHPHASES]; // switches measured
+unsigned long SchedBenchMax[SCHEDBENCHPHASES];  // bus cycles
+unsigned long SchedBenchAvg[SCHEDBENCHPHASES];  // bus cycles
+uint64_t SchedBenchTotal;
+unsigned long SchedBenchStamp;                  // OS_Time() before the last OS_Suspend
+bool SchedBenchValid;                           // SchedBenchStamp was taken by a worker
+bool SchedBenchStop;                            // tells the workers to quit
+
+void SchedBenchWorker(void){
+	unsigned long latency;
+	while (!SchedBenchStop){
+		if (SchedBenchValid){
+			latency = OS_TimeDifference(SchedBenchStamp, OS_Time());
+			SchedBenchTotal += latency;
+			SchedBenchSwitches[SchedBenchPhase]++;
+			if (latency > SchedBenchMax[SchedBenchPhase]){
+				SchedBenchMax[SchedBenchPhase] = latency;
+			}
+		}
+		SchedBenchValid = true;
+		SchedBenchStamp = OS_Time();
+		OS_Suspend();
+	}
+	SchedBenchWorkers--;
+	OS_Kill();
+}
+
+void SchedBenchMain(void){
+	long live;
+	for (SchedBenchPhase = 0; SchedBenchPhase < SCHEDBENCHPHASES; SchedBenchPhase++){
+		SchedBenchStop = false;
+		SchedBenchTotal = 0;
+		for (live = OS_CheckThreads(); (live >= 0) && (live < (long)SchedBenchLive[SchedBenchPhase]); live++){
+			if (OS_AddThread(&SchedBenchWorker, 256, 2) == 0){
+				SchedBenchAddFails++;
+				break;
+			}
+			SchedBenchWorkers++;
+		}
+		SchedBenchValid = false; // the stamp of the last switch into this thread does not count
+		OS_Sleep(SCHEDBENCHMS);
+		SchedBenchStop = true;
+		SchedBenchValid = false;
+		while (SchedBenchWorkers){
+			OS_Sleep(1);
+		}
+		if (SchedBenchSwitches[SchedBenchPhase]){
+			SchedBenchAvg[SchedBenchPhase] = (unsigned long)(SchedBenchTotal/SchedBenchSwitches[SchedBenchPhase]);
+		}
+	}
+	OS_Kill();
+}
+
+void SchedBench_Init(void){
+	OS_AddThread(&SchedBenchMain, 256, 1);
+}
+#endif
+
 //------------------Task 2--------------------------------
 // background thread executes with SW1 button
 // one foreground task created with button push
@@ -243,13 +930,13 @@ void Consumer(void){
 	while(1){
 		jsDataType data;
 		JsFifo_Get(&data);
-		OS_bWait(&LCDFree);
+		OS_MutexLock(&LCDFree);
 			
 		BSP_LCD_DrawCrosshair(prevx, prevy, LCD_BLACK); // Draw a black crosshair
 		BSP_LCD_DrawCrosshair(data.x, data.y, LCD_RED); // Draw a red crosshair
 
 		ConsumerCount++;
-		OS_bSignal(&LCDFree);
+		OS_MutexUnlock(&LCDFree);
 		prevx = data.x; 
 		prevy = data.y;
 		//OS_Suspend();
@@ -261,19 +948,100 @@ void do_noting(void) {}
 
 //--------------end of Task 3-----------------------------
 
+#ifdef TRACEDRAIN
+//************ TraceDrainer *************** 
+// lowest priority thread, moves kernel trace records into UART0
+// 115200 baud empties the 16 byte software FIFO in about 1.4ms
+// inputs:  none
+// outputs: none
+void TraceDrainer(void){
+	while(1){
+		Trace_Drain();
+		OS_Sleep(2);
+	}
+}
+#endif
+
+#ifdef CRITDUMP
+//************ CritDumper *************** 
+// low priority thread, sends the critical section profile when SW1 is pushed
+// inputs:  none
+// outputs: none
+Sema4Type CritDumpReq;
+void CritDumper(void){
+	while(1){
+		OS_bWait(&CritDumpReq);
+		Crit_Dump();
+	}
+}
+#endif
+
+#ifdef LOCKSTATS
+#ifndef semaStats
+#error "LOCKSTATS needs semaStats in os.h"
+#endif
+//************ LockRanker *************** 
+// low priority thread, clears the lock counters, lets the game run for
+// 30 s, then sorts the locks by total wait time into LockRank and sends
+// one line per lock out UART0: name, acquisitions, contended, failed,
+// total and max wait in 12.5ns units
+// inputs:  none
+// outputs: none
+#define LOCKRANKS 16
+#define LOCKRUNMS 30000
+LockStatsType *LockRank[LOCKRANKS]; // most waited on first
+uint32_t LockRanked;                // locks in LockRank
+void LockRanker(void){
+	LockStatsType *pt;
+	uint32_t i, j;
+	OS_ClearLockStats();
+	OS_Sleep(LOCKRUNMS);
+	LockRanked = 0;
+	for (pt = OS_NextLock(0); pt; pt = OS_NextLock(pt)){
+		for (i = LockRanked; (i > 0) && (LockRank[i-1]->WaitTotal < pt->WaitTotal); i--){
+			if (i < LOCKRANKS){
+				LockRank[i] = LockRank[i-1];
+			}
+		}
+		if (i < LOCKRANKS){
+			LockRank[i] = pt;
+			if (LockRanked < LOCKRANKS){
+				LockRanked++;
+			}
+		}
+	}
+	for (j = 0; j < LockRanked; j++){
+		pt = LockRank[j];
+		UART_OutString(pt->Name ? (char *)pt->Name : "?");
+		UART_OutString(" n ");
+		UART_OutUDec(pt->Acquisitions);
+		UART_OutString(" contended ");
+		UART_OutUDec(pt->Contended);
+		UART_OutString(" failed ");
+		UART_OutUDec(pt->Failed);
+		UART_OutString(" wait ");
+		UART_OutUDec((uint32_t)pt->WaitTotal);
+		UART_OutString(" max ");
+		UART_OutUDec(pt->WaitMax);
+		OutCRLF();
+	}
+	OS_Kill();
+}
+#endif
+
 //************ Display *************** 
 // foreground thread, do some pseudo works to test if you can add multiple periodic threads
 // inputs:  none
 // outputs: none
 void Display(void){
 	while(1){
-		OS_bWait(&LCDFree);
+		OS_MutexLock(&LCDFree);
 		BSP_LCD_Message(1, 5, 0, "Life:",life);		
 		BSP_LCD_Message(1, 5, 9, "Score:",score);
 		BSP_LCD_Message(0, 0, 6, "Level:", level);
 		//BSP_LCD_Message(1,4,0,"PseudoCount: ",PseudoCount);
 		DisplayCount++;
-		OS_bSignal(&LCDFree);
+		OS_MutexUnlock(&LCDFree);
 		//OS_Sleep(1);
 		//OS_Suspend();
 
@@ -286,10 +1054,28 @@ void Display(void){
 //------------------Task 8--------------------------------
 // 
 // 
+// Called as each cube of a wave finishes, the last one wakes CubeSpawner
+void CubeDone(void){
+	OS_bWait(&cubesLeftFree);
+	CubesLeft--;
+	if (CubesLeft == 0){
+		OS_SetEventFlags(&GameEvents, CUBES_DEAD);
+	}
+	OS_bSignal(&cubesLeftFree);
+}
+
 // This task implements the motions of the cubes
-void CubeThread (void){
+// runs as a pool job, so it returns instead of killing itself
+void CubeJob (void *arg){
 	int i;
 	cube * c = 0;
+	(void)arg;
+	unsigned long spawnTime = OS_TimeDifference(WaveStartTime, OS_Time());
+	if (spawnTime > SpawnMaxTime){
+		SpawnMaxTime = spawnTime;
+	}
+	SpawnTotalTime += spawnTime;
+	SpawnCount++;
 	for (i=0; i<NUMCUBES; i++){
 		if (OS_bTry(&(CubeArray[i].CubeFree)) && !CubeArray[i].is_alive){
 			c = &(CubeArray[i]);
@@ -298,7 +1084,10 @@ void CubeThread (void){
 		}
 	}
 	if (c == 0){
-		OS_Kill();
+#ifdef CUBEEVENTS
+		CubeDone();
+#endif
+		return;
 	}
 	bool found_start = false;
 	while (!found_start){
@@ -307,16 +1096,16 @@ void CubeThread (void){
 		if (OS_bTry(&(BlockArray[cube_posy][cube_posx].BlockFree))){
 			c->position[0] = cube_posy;
 			c->position[1] = cube_posx;
-			OS_bWait(&LCDFree);
+			OS_MutexLock(&LCDFree);
 			BSP_LCD_Cube(CUBESIZE*c->position[1]+CUBESIZE/2+13, CUBESIZE*c->position[0]+CUBESIZE/2, CUBESIZE, CUBECOLOR);
-			OS_Signal(&LCDFree);
+			OS_MutexUnlock(&LCDFree);
 			c->direction = getRandomNumber()/64;
 			found_start = true;
 		}
 
 	}
-	unsigned long cube_start_time = OS_MsTime();
-	unsigned long last_move_time = OS_MsTime();
+	uint64_t cube_start_time = OS_Time64(); // OS_Time64 never jumps back like OS_MsTime can
+	uint64_t last_move_time = cube_start_time;
 	while (c->is_alive && life){
 		// first, check if the object is hit by the crosshair
 		if((c->position[0] == (y-4) / CUBESIZE  && c->position[1] == (x - 13) / CUBESIZE) ||
@@ -325,10 +1114,10 @@ void CubeThread (void){
 		   (c->position[0] == y / CUBESIZE  && c->position[1] == (x - 9) / CUBESIZE)){
 			// Increase the score
 			c->is_alive = false;
-			OS_bWait(&LCDFree);
+			OS_MutexLock(&LCDFree);
 			BSP_LCD_Cube(CUBESIZE*c->position[1]+CUBESIZE/2+13, CUBESIZE*c->position[0]+CUBESIZE/2, CUBESIZE, BGCOLOR);
-			OS_CreateSound(262, 1);
-			OS_Signal(&LCDFree);
+			OS_MutexUnlock(&LCDFree);
+			OS_CreateSound(262, 1); // busy-waits, so play it after the LCD is released
 			OS_bWait(&scoreFree);
 			score++;
 			if (score % 10 == 0) {
@@ -343,12 +1132,12 @@ void CubeThread (void){
 			OS_bSignal(&(c->CubeFree));
 		}
 		// second, check if the object is expired
-		else if (OS_MsTime() - cube_start_time > EXPIRATIONTIME_MS){
+		else if (OS_Time64() - cube_start_time > (uint64_t)EXPIRATIONTIME_MS*TIME_1MS){
 			// Decrease the life
 			c->is_alive = false;
-			OS_bWait(&LCDFree);
+			OS_MutexLock(&LCDFree);
 			BSP_LCD_Cube(CUBESIZE*c->position[1]+CUBESIZE/2+13, CUBESIZE*c->position[0]+CUBESIZE/2, CUBESIZE, BGCOLOR);
-			OS_Signal(&LCDFree);
+			OS_MutexUnlock(&LCDFree);
 			OS_bWait(&lifeFree);
 			if (life > 0){
 				life--;
@@ -362,7 +1151,7 @@ void CubeThread (void){
 			// update the cube information
 			// then, display the object
 			// last,decide next direction
-			while (OS_MsTime() - last_move_time < CUBEMOVETIME_MS){
+			while (OS_Time64() - last_move_time < (uint64_t)CUBEMOVETIME_MS*TIME_1MS){
 				OS_Suspend();
 			}
 			uint8_t next_x = c->position[1] + (c->direction % 2) * ((c->direction/2) * 2 - 1);
@@ -373,10 +1162,10 @@ void CubeThread (void){
 				next_y = c->position[0] + (1 - c->direction % 2) * ((c->direction/2) * 2 - 1);
 				if (next_x < HORIZONTALNUM && next_y < VERTICALNUM && OS_bTry(&(BlockArray[next_y][next_x].BlockFree))){
 					OS_bSignal(&(BlockArray[c->position[0]][c->position[1]].BlockFree));
-					OS_bWait(&LCDFree);
+					OS_MutexLock(&LCDFree);
 					BSP_LCD_Cube(CUBESIZE*c->position[1]+CUBESIZE/2+13, CUBESIZE*c->position[0]+CUBESIZE/2, CUBESIZE, BGCOLOR);
 					BSP_LCD_Cube(CUBESIZE*next_x+CUBESIZE/2+13, CUBESIZE*next_y+CUBESIZE/2, CUBESIZE, CUBECOLOR);
-					OS_Signal(&LCDFree);
+					OS_MutexUnlock(&LCDFree);
 					c->position[0] = next_y;
 					c->position[1] = next_x;
 					found_pos = true;
@@ -385,17 +1174,25 @@ void CubeThread (void){
 					c->direction = getRandomNumber()/64;
 				}
 			}
-			last_move_time = OS_MsTime();
+			last_move_time = OS_Time64();
 		}
 	}
 	if (c->is_alive){
 		c->is_alive = false;
-		OS_bWait(&LCDFree);
+		OS_MutexLock(&LCDFree);
 		BSP_LCD_Cube(CUBESIZE*c->position[1]+CUBESIZE/2, CUBESIZE*c->position[0]+CUBESIZE/2, CUBESIZE, BGCOLOR);
-		OS_Signal(&LCDFree);
+		OS_MutexUnlock(&LCDFree);
 		OS_bSignal(&(BlockArray[c->position[0]][c->position[1]].BlockFree));
 		OS_bSignal(&(c->CubeFree));
 	}
+#ifdef CUBEEVENTS
+	CubeDone();
+#endif
+}
+
+// one thread per cube, used when CUBEPOOL is not defined
+void CubeThread (void){
+	CubeJob(0);
 	OS_Kill(); // Cube should disappear, kill the thread
 }
 
@@ -405,9 +1202,40 @@ void CubeThread (void){
 // 
 // 
 // This task implements the motions of the cubes
+// Start one cube, counted in NumJobs or NumCreated, returns 1 if successful
+int SpawnCube(void){
+#ifdef CUBEPOOL
+	if (OS_SubmitJob(&CubeJob, 0)){
+		NumJobs++;
+		return 1;
+	}
+#else
+	if (OS_AddThread(&CubeThread, 400, 1)){
+		NumCreated++;
+		return 1;
+	}
+#endif
+	return 0;
+}
+
 void CubeSpawner (void){
 	spawner_active = true;
 	while(life){ // Implement until the game is over
+#ifdef CUBEEVENTS
+		uint8_t num_cubes = getRandomNumber()/(255/(NUMCUBES)+1)+1;
+		uint8_t j;
+		OS_bWait(&cubesLeftFree);
+		CubesLeft = num_cubes;
+		OS_bSignal(&cubesLeftFree);
+		WaveStartTime = OS_Time();
+		for (j=0; j<num_cubes; j++){
+			if (SpawnCube() == 0){
+				CubeDone(); // never started, do not wait for it
+			}
+		}
+		OS_WaitEventFlags(&GameEvents, CUBES_DEAD, OS_FLAGS_ANY|OS_FLAGS_CLEAR);
+		SpawnerPasses++;
+#else
 		bool blocksExist = true;
 		while(blocksExist){
 			int i;
@@ -421,12 +1249,15 @@ void CubeSpawner (void){
 			if (!blocksExist){
 				uint8_t num_cubes = getRandomNumber()/(255/(NUMCUBES)+1)+1;
 				uint8_t j;
+				WaveStartTime = OS_Time();
 				for (j=0; j<num_cubes; j++){
-					NumCreated += OS_AddThread(&CubeThread, 128, 1);
+					SpawnCube();
 				}
 			}
+			SpawnerPasses++;
 			OS_Suspend();
 		}
+#endif
 	}
 	int noteArray[9] = {415, 415, 415, 311, 311, 208, 208, 233, 233};
 	int tempoArray[9] = {3, 3, 1, 3, 3, 3, 3, 2, 3};
@@ -434,7 +1265,7 @@ void CubeSpawner (void){
 	spawner_active = false;
 	game_started = false;
 	OS_Sleep(50); // wait
-	OS_bWait(&LCDFree);
+	OS_MutexLock(&LCDFree);
 	BSP_LCD_FillScreen(BGCOLOR);
 	BSP_LCD_FillScreen(BGCOLOR);
 	if (score > high_score) {
@@ -446,7 +1277,7 @@ void CubeSpawner (void){
 	BSP_LCD_DrawString(5,7,"Press S2 to",LCD_WHITE);
 	BSP_LCD_DrawString(5,8,"Play Again!",LCD_WHITE);
 	while (!game_started);
-	OS_bSignal(&LCDFree);
+	OS_MutexUnlock(&LCDFree);
 	OS_Kill(); //Life = 0, game is over, kill the thread
 }
 
@@ -462,7 +1293,7 @@ void Restart(void){
 	OS_Sleep(50); // wait
 	StartTime = OS_MsTime();
 	ElapsedTime = 0;
-	OS_bWait(&LCDFree);
+	OS_MutexLock(&LCDFree);
 	Button2RespTime = OS_MsTime() - Button2PushTime; // Response on LCD here
 	BSP_LCD_FillScreen(BGCOLOR);
 	while (ElapsedTime < 500){
@@ -471,7 +1302,7 @@ void Restart(void){
 		BSP_LCD_DrawString(5,6,"Restarting",LCD_WHITE);
 	}
 	BSP_LCD_FillScreen(BGCOLOR);
-	OS_bSignal(&LCDFree);
+	OS_MutexUnlock(&LCDFree);
 	// restart
 	OS_bWait(&lifeFree);
 	life = 3;
@@ -487,7 +1318,7 @@ void Restart(void){
 	int tempoArray[9] = {2, 1, 2, 2, 1, 1, 2, 2, 3};
 	OS_Music(noteArray, tempoArray);
 	if (!spawner_active){
-		NumCreated += OS_AddThread(&CubeSpawner,128,2); 
+		NumCreated += OS_AddThread(&CubeSpawner,400,2); 
 	}
   OS_Kill();  // done, OS does not return from a Kill
 } 
@@ -498,6 +1329,9 @@ void Restart(void){
 // background threads execute once and return
 void SW1Push(void){
 	game_started = true;	
+#ifdef CRITDUMP
+	OS_bSignal(&CritDumpReq);
+#endif
 	OS_AddSW1Task(*do_noting, 5);
 }
 
@@ -505,13 +1339,12 @@ void SW1Push(void){
 // Called when Button2 pushed
 // Adds another foreground task
 // background threads execute once and return
+DebounceType SW2Debounce;
 void SW2Push(void){
-  if(OS_MsTime() > 20 ){ // debounce
-    if(OS_AddThread(&Restart,128,4)){
-			OS_ClearMsTime();
+  if(OS_Debounce(&SW2Debounce, 20*TIME_1MS)){ // at least 20ms between touches
+    if(OS_AddThread(&Restart,400,4)){
       NumCreated++; 
     }
-    OS_ClearMsTime();  // at least 20ms between touches
 		Button2PushTime = OS_MsTime(); // Time stamp
   }
 }
@@ -537,14 +1370,23 @@ int main(void){
 	Random_Init();
 	OS_InitSemaphore(&scoreFree, 1);
 	OS_InitSemaphore(&lifeFree, 1);
+	OS_InitSemaphore(&cubesLeftFree, 1);
+	OS_NameSemaphore(&scoreFree, "scoreFree");
+	OS_NameSemaphore(&lifeFree, "lifeFree");
+	OS_NameSemaphore(&cubesLeftFree, "cubesLeftFree");
+	OS_InitEventFlags(&GameEvents, 0);
 	uint8_t i;
 	uint8_t j;
 	for (i=0; i<NUMCUBES; i++){
 		OS_InitSemaphore(&(CubeArray[i].CubeFree), 1);
+		IndexName(CubeFreeName[i], "CubeFree", 0, i);
+		OS_NameSemaphore(&(CubeArray[i].CubeFree), CubeFreeName[i]);
 	}
 	for (i=0; i<HORIZONTALNUM; i++){
 		for (j=0; j<VERTICALNUM; j++){
 			OS_InitSemaphore(&(BlockArray[j][i].BlockFree), 1);
+			IndexName(BlockFreeName[j][i], "BlockFree", j, i);
+			OS_NameSemaphore(&(BlockArray[j][i].BlockFree), BlockFreeName[j][i]);
 		}
 	}
 	DataLost = 0;        // lost data between producer and consumer
@@ -565,16 +1407,60 @@ int main(void){
 	OS_AddSW2Task(&SW2Push, 4);
 	// OS_AddPeriodicThread(&PeriodicUpdater, PSEUDOPERIOD, 3);
 	OS_AddPeriodicThread(&Producer, PERIOD, 1); // 2 kHz real time sampling of PD3
+#ifdef WHEELTEST
+	WheelTest_Init();
+#endif
+#ifdef DEADLINETEST
+	DeadlineTest_Init();
+#endif
+#ifdef RINGBENCH
+	RingBench();
+#endif
+#ifdef POOLBENCH
+	PoolBench();
+#endif
+#ifdef MSGBENCH
+	MsgBench_Init();
+#endif
+#ifdef NOTIFYBENCH
+	NotifyBench_Init();
+#endif
+#ifdef AGINGTEST
+	AgingTest_Init();
+#endif
+#ifdef THREADSTRESS
+	ThreadStress_Init();
+#endif
+#ifdef SEMASTRESS
+	SemaStress_Init();
+#endif
 
 	NumCreated = 0 ;
+#ifdef SCHEDBENCH
+	SchedBench_Init(); // needs the TCBs the game threads would take
+#else
 	// create initial foreground threads
-	NumCreated += OS_AddThread(&Consumer, 128, 1); 
-	NumCreated += OS_AddThread(&Display, 128, 1);
+	NumCreated += OS_AddThread(&Consumer, 400, 1); 
+	NumCreated += OS_AddThread(&Display, 400, 1);
+#ifdef CUBEPOOL
+	NumWorkers = OS_InitThreadPool(NUMCUBES, 400, 1); // one worker per cube
+#endif
 	
 	int noteArray[9] = {311, 155, 233, 233, 208, 208, 155, 311, 233};
 	int tempoArray[9] = {32, 16, 32, 32, 16, 16, 32, 32, 48};
 	OS_Music(noteArray, tempoArray);
-	NumCreated += OS_AddThread(&CubeSpawner,128,2);
+	NumCreated += OS_AddThread(&CubeSpawner,400,2);
+#endif
+#ifdef TRACEDRAIN
+	NumCreated += OS_AddThread(&TraceDrainer, 256, 6);
+#endif
+#ifdef CRITDUMP
+	OS_InitSemaphore(&CritDumpReq, 0);
+	NumCreated += OS_AddThread(&CritDumper, 256, 6);
+#endif
+#ifdef LOCKSTATS
+	NumCreated += OS_AddThread(&LockRanker, 256, 6);
+#endif
 	//   NumCreated += OS_AddThread(&Interpreter, 128, 2); 
 	// NumCreated += OS_AddThread(&CubeNumCalc, 128, 3); 
 
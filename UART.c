@@ -32,6 +32,7 @@
 
 #include "UART_FIFO.h"
 #include "UART.h"
+#include "os.h"
 
 #define NVIC_EN0_INT5           0x00000020  // Interrupt 5 enable
 
@@ -102,7 +103,7 @@ void UART_Init(void){
 // stop when hardware RX FIFO is empty or software RX FIFO is full
 void static copyHardwareToSoftware(void){
   char letter;
-  while(((UART0_FR_R&UART_FR_RXFE) == 0) && (Rx_UARTFifo_Size() < (FIFOSIZE - 1))){
+  while(((UART0_FR_R&UART_FR_RXFE) == 0) && (Rx_UARTFifo_Size() < FIFOSIZE)){
     letter = UART0_DR_R;
     Rx_UARTFifo_Put(letter);
   }
@@ -124,18 +125,32 @@ char UART_InChar(void){
   return(letter);
 }
 // output ASCII character to UART
-// spin if TxFifo is full
+// yield to other threads while TxFifo is full
 void UART_OutChar(char data){
-  while(Tx_UARTFifo_Put(data) == FIFOFAIL){};
+  while(Tx_UARTFifo_Put(data) == FIFOFAIL){
+    OS_Suspend();
+  }
+  UART0_IM_R &= ~UART_IM_TXIM;          // disable TX FIFO interrupt
+  copySoftwareToHardware();
+  UART0_IM_R |= UART_IM_TXIM;           // enable TX FIFO interrupt
+}
+// output 8-bit to UART without waiting
+// return 0 if TxFifo is full
+int UART_TryOutChar(char data){
+  if(Tx_UARTFifo_Put(data) == FIFOFAIL){
+    return 0;
+  }
   UART0_IM_R &= ~UART_IM_TXIM;          // disable TX FIFO interrupt
   copySoftwareToHardware();
   UART0_IM_R |= UART_IM_TXIM;           // enable TX FIFO interrupt
+  return 1;
 }
 // at least one of three things has happened:
 // hardware TX FIFO goes from 3 to 2 or less items
 // hardware RX FIFO goes from 1 to 2 or more items
 // UART receiver has timed out
 void UART0_Handler(void){
+  OS_IsrEnter();
   if(UART0_RIS_R&UART_RIS_TXRIS){       // hardware TX FIFO <= 2 items
     UART0_ICR_R = UART_ICR_TXIC;        // acknowledge TX FIFO
     // copy from software TX FIFO to hardware TX FIFO
@@ -154,6 +169,7 @@ void UART0_Handler(void){
     // copy from hardware RX FIFO to software RX FIFO
     copyHardwareToSoftware();
   }
+  OS_IsrExit();
 }
 
 //------------UART_OutString------------
@@ -56,6 +56,12 @@ char UART_InChar(void);
 // Output: none
 void UART_OutChar(char data);
 
+//------------UART_TryOutChar------------
+// Output 8-bit to serial port without waiting
+// Input: letter is an 8-bit character to be transferred
+// Output: 1 if queued, 0 if the transmit FIFO is full
+int UART_TryOutChar(char data);
+
 //------------UART_OutString------------
 // Output String (NULL termination)
 // Input: pointer to a NULL-terminated string to be transferred
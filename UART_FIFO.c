@@ -25,115 +25,81 @@
  http://users.ece.utexas.edu/~valvano/
  */
 
+#include <stdint.h>
 #include "os.h"
+#include "FIFO.h"
 #include "UART_FIFO.h"
 
-// Two-index implementation of the transmit FIFO
+// Transmit FIFO, threads put and UART0_Handler gets
+// several threads may put (UART_OutChar, Trace_Drain), so puts are made atomic
 // can hold 0 to TXFIFOSIZE elements
 #define TXFIFOSIZE 16 // must be a power of 2
 #define TXFIFOSUCCESS 1
 #define TXFIFOFAIL    0
 
-
-unsigned long volatile Tx_UARTPutI;// put next
-unsigned long volatile Tx_UARTGetI;// get next
-tx_UARTDataType static Tx_UARTFifo[TXFIFOSIZE];
-
-Sema4Type Tx_UARTRoomType;
+AddRing(Tx_UART, TXFIFOSIZE, tx_UARTDataType)
 	
-// initialize index FIFO
+// initialize transmit FIFO
 void Tx_UARTFifo_Init(void){ long sr;
   sr = StartCritical(); // make atomic
-  OS_InitSemaphore(&Tx_UARTRoomType, TXFIFOSIZE);
-  Tx_UARTPutI = Tx_UARTGetI = 0;  // Empty
+  Tx_UARTRing_Init();   // Empty
   EndCritical(sr);
 }
-// add element to end of index FIFO
-// return TXFIFOSUCCESS if successful
-int Tx_UARTFifo_Put(tx_UARTDataType data){
-  OS_Wait(&Tx_UARTRoomType);
-	
-	if((Tx_UARTPutI-Tx_UARTGetI) & ~(TXFIFOSIZE-1)){
-    return(TXFIFOFAIL); // Failed, fifo full
-  }
-  Tx_UARTFifo[Tx_UARTPutI&(TXFIFOSIZE-1)] = data; // put
-  Tx_UARTPutI++;  // Success, update
-  return(TXFIFOSUCCESS);
+// add element to end of transmit FIFO
+// return TXFIFOSUCCESS if successful, TXFIFOFAIL if full
+int Tx_UARTFifo_Put(tx_UARTDataType data){ long sr;
+  int status;
+  sr = StartCritical(); // the ring has one producer, a switch here would let a second one in
+  status = Tx_UARTRing_Put(data);
+  EndCritical(sr);
+  return(status);
 }
-// remove element from front of index FIFO
-// return TXFIFOSUCCESS if successful
+// remove element from front of transmit FIFO
+// return TXFIFOSUCCESS if successful, TXFIFOFAIL if empty
 int Tx_UARTFifo_Get(tx_UARTDataType *datapt){
-  if(Tx_UARTPutI == Tx_UARTGetI ){
-    return(TXFIFOFAIL); // Empty if TxPutI=TxGetI
-  }
-  *datapt = Tx_UARTFifo[Tx_UARTGetI&(TXFIFOSIZE-1)];
-  Tx_UARTGetI++;  // Success, update
-  OS_Signal(&Tx_UARTRoomType);
-	
-  return(TXFIFOSUCCESS);
+  return(Tx_UARTRing_Get(datapt));
 }
-// number of elements in index FIFO
-// 0 to TXFIFOSIZE-1
+// number of elements in transmit FIFO
+// 0 to TXFIFOSIZE
 unsigned short Tx_UARTFifo_Size(void){
- return ((unsigned short)(Tx_UARTPutI-Tx_UARTGetI));
+ return ((unsigned short)Tx_UARTRing_Size());
 }
 
-// Two-pointer implementation of the receive FIFO
-// can hold 0 to RXFIFOSIZE-1 elements
-#define RXFIFOSIZE 10 // can be any size
+// Receive FIFO, UART0_Handler puts and threads get
+// can hold 0 to RXFIFOSIZE elements
+#define RXFIFOSIZE 16 // must be a power of 2
 #define RXFIFOSUCCESS 1
 #define RXFIFOFAIL    0
 
-rx_UARTDataType volatile *Rx_UARTPutPt; // put next
-rx_UARTDataType volatile *Rx_UARTGetPt; // get next
-rx_UARTDataType static Rx_UARTFifo[RXFIFOSIZE];
+AddRing(Rx_UART, RXFIFOSIZE, rx_UARTDataType)
 
 Sema4Type Rx_UARTDataAvailable;
 
-// initialize pointer FIFO
+// initialize receive FIFO
 void Rx_UARTFifo_Init(void){ long sr;
   sr = StartCritical();      // make atomic
   OS_InitSemaphore(&Rx_UARTDataAvailable, 0);
-  Rx_UARTPutPt = Rx_UARTGetPt = &Rx_UARTFifo[0]; // Empty
+  OS_NameSemaphore(&Rx_UARTDataAvailable, "Rx_UARTDataAvailable");
+  Rx_UARTRing_Init();        // Empty
   EndCritical(sr);
 }
-// add element to end of pointer FIFO
+// add element to end of receive FIFO
 // return RXFIFOSUCCESS if successful
 int Rx_UARTFifo_Put(rx_UARTDataType data){
-  rx_UARTDataType volatile *nextPutPt;
-  nextPutPt = Rx_UARTPutPt+1;
-  if(nextPutPt == &Rx_UARTFifo[RXFIFOSIZE]){
-    nextPutPt = &Rx_UARTFifo[0];  // wrap
-  }
-  if(nextPutPt == Rx_UARTGetPt){
+  if(Rx_UARTRing_Put(data) == RINGFAIL){
     return(RXFIFOFAIL);      // Failed, fifo full
   }
-  else{
-    *(Rx_UARTPutPt) = data;       // Put
-    Rx_UARTPutPt = nextPutPt;     // Success, update
 	OS_Signal(&Rx_UARTDataAvailable);
-    return(RXFIFOSUCCESS);
-  }
+  return(RXFIFOSUCCESS);
 }
-// remove element from front of pointer FIFO
+// remove element from front of receive FIFO, wait while it is empty
 // return RXFIFOSUCCESS if successful
 int Rx_UARTFifo_Get(rx_UARTDataType *datapt){
 	OS_Wait(&Rx_UARTDataAvailable);
-	
-	if(Rx_UARTPutPt == Rx_UARTGetPt ){
-    return(RXFIFOFAIL);      // Empty if PutPt=GetPt
-  }
-  *datapt = *(Rx_UARTGetPt++);
-  if(Rx_UARTGetPt == &Rx_UARTFifo[RXFIFOSIZE]){
-     Rx_UARTGetPt = &Rx_UARTFifo[0];   // wrap
-  }
-  return(RXFIFOSUCCESS);
+  return(Rx_UARTRing_Get(datapt));
 }
-// number of elements in pointer FIFO
-// 0 to RXFIFOSIZE-1
+// number of elements in receive FIFO
+// 0 to RXFIFOSIZE
 unsigned short Rx_UARTFifo_Size(void){
-  if(Rx_UARTPutPt < Rx_UARTGetPt){
-    return ((unsigned short)(Rx_UARTPutPt-Rx_UARTGetPt+(RXFIFOSIZE*sizeof(rx_UARTDataType)))/sizeof(rx_UARTDataType));
-  }
-  return ((unsigned short)(Rx_UARTPutPt-Rx_UARTGetPt)/sizeof(rx_UARTDataType));
+  return ((unsigned short)Rx_UARTRing_Size());
 }
@@ -7,28 +7,28 @@ void EndCritical(long sr);    // restore I bit to previous value
 typedef char tx_UARTDataType;
 typedef char rx_UARTDataType;
 
-// initialize index FIFO
+// initialize transmit FIFO
 void Tx_UARTFifo_Init(void);
-// add element to end of index FIFO
-// return TXFIFOSUCCESS if successful
+// add element to end of transmit FIFO, does not wait
+// return TXFIFOSUCCESS if successful, TXFIFOFAIL if full
 int Tx_UARTFifo_Put(tx_UARTDataType data);
-// remove element from front of index FIFO
-// return TXFIFOSUCCESS if successful
+// remove element from front of transmit FIFO
+// return TXFIFOSUCCESS if successful, TXFIFOFAIL if empty
 int Tx_UARTFifo_Get(tx_UARTDataType *datapt);
-// number of elements in index FIFO
-// 0 to TXFIFOSIZE-1
+// number of elements in transmit FIFO
+// 0 to TXFIFOSIZE
 unsigned short Tx_UARTFifo_Size(void);
 
-// initialize pointer FIFO
+// initialize receive FIFO
 void Rx_UARTFifo_Init(void);
-// add element to end of pointer FIFO
+// add element to end of receive FIFO
 // return RXFIFOSUCCESS if successful
 int Rx_UARTFifo_Put(rx_UARTDataType data);
-// remove element from front of pointer FIFO
+// remove element from front of receive FIFO, waits while it is empty
 // return RXFIFOSUCCESS if successful
 int Rx_UARTFifo_Get(rx_UARTDataType *datapt);
-// number of elements in pointer FIFO
-// 0 to RXFIFOSIZE-1
+// number of elements in receive FIFO
+// 0 to RXFIFOSIZE
 unsigned short Rx_UARTFifo_Size(void);
 
 #endif
@@ -0,0 +1,175 @@
+// filename **********critical.c***********
+// Critical section latency profiler for the cube-crusher RTOS
+// The wrappers mask interrupts with the real StartCritical first and take
+// the time stamp after, and take the end time stamp before unmasking, so
+// the bookkeeping is not part of the measured time. Masked sections never
+// overlap, interrupts cannot run inside one, so a single open section is
+// kept. The site table is a hash on the start address with linear probing.
+
+#include <stdint.h>
+#include "os.h"
+#include "UART.h"
+#include "critical.h"
+
+// the wrappers call the real functions in startup.s and osasm.s
+#undef StartCritical
+#undef EndCritical
+#undef OS_DisableInterrupts
+#undef OS_EnableInterrupts
+#undef DisableInterrupts
+#undef EnableInterrupts
+long StartCritical(void);     // previous I bit, disable interrupts
+void EndCritical(long sr);    // restore I bit to previous value
+void OS_EnableInterrupts(void);
+
+#ifdef __ARMCC_VERSION
+#define CRITCALLER() ((uint32_t)__return_address())
+#else
+#define CRITCALLER() ((uint32_t)(uintptr_t)__builtin_return_address(0))
+#endif
+
+CritSiteType CritSites[CRITSITES];
+uint32_t CritMaxTime;         // longest masked time of any site, 12.5ns units
+uint32_t CritMaxStart;        // Start of the site that masked for CritMaxTime
+uint32_t CritLost;            // sections not recorded because every site was in use
+
+static uint32_t OpenStart;    // caller of the outermost section that is open, 0 if none
+static uint32_t OpenTime;     // OS_Time() when it masked interrupts
+
+// ******** Crit_Reset ************
+// forget every site and start measuring again
+// Inputs: none
+// Outputs: none
+void Crit_Reset(void){
+	int i, j;
+	long sr = StartCritical();
+	for (i = 0; i < CRITSITES; i++){
+		CritSites[i].Start = 0;
+		CritSites[i].Count = 0;
+		CritSites[i].MaxTime = 0;
+		for (j = 0; j < CRITBINS; j++){
+			CritSites[i].Histogram[j] = 0;
+		}
+	}
+	CritMaxTime = 0;
+	CritMaxStart = 0;
+	CritLost = 0;
+	OpenStart = 0;
+	EndCritical(sr);
+}
+
+// ******** CritOpen ************
+// remember where and when the outermost section started
+// Inputs: previous I bit, return address of the caller
+// Outputs: none
+static void CritOpen(long sr, uint32_t start){
+	if ((sr&1) == 0){ // interrupts were enabled, this is the outermost section
+		OpenStart = start;
+		OpenTime = OS_Time();
+	}
+}
+
+// ******** CritClose ************
+// charge the open section to its site, call with interrupts still disabled
+// Inputs: OS_Time() when it ended
+// Outputs: none
+static void CritClose(uint32_t end){
+	uint32_t elapsed, bin, i, n;
+	CritSiteType *site;
+	if (OpenStart == 0){ // masked by something else, e.g. OS_Init before StartOS
+		return;
+	}
+	elapsed = OS_TimeDifference(OpenTime, end);
+	i = (OpenStart>>1)%CRITSITES;
+	for (n = 0; n < CRITSITES; n++){
+		site = &CritSites[i];
+		if ((site->Start == OpenStart) || (site->Start == 0)){
+			site->Start = OpenStart;
+			site->Count++;
+			if (elapsed > site->MaxTime){
+				site->MaxTime = elapsed;
+			}
+			bin = elapsed/CRITBINTIME;
+			if (bin >= CRITBINS){
+				bin = CRITBINS-1;
+			}
+			site->Histogram[bin]++;
+			if (elapsed > CritMaxTime){
+				CritMaxTime = elapsed;
+				CritMaxStart = OpenStart;
+			}
+			OpenStart = 0;
+			return;
+		}
+		i = (i+1 == CRITSITES) ? 0 : i+1;
+	}
+	CritLost++;
+	OpenStart = 0;
+}
+
+long Crit_StartCritical(void){
+	long sr = StartCritical();
+	CritOpen(sr, CRITCALLER());
+	return sr;
+}
+
+void Crit_EndCritical(long sr){
+	uint32_t end = OS_Time();
+	if ((sr&1) == 0){ // interrupts are about to be enabled again
+		CritClose(end);
+	}
+	EndCritical(sr);
+}
+
+void Crit_DisableInterrupts(void){
+	long sr = StartCritical();
+	CritOpen(sr, CRITCALLER());
+}
+
+void Crit_EnableInterrupts(void){
+	CritClose(OS_Time());
+	OS_EnableInterrupts();
+}
+
+// ******** Crit_Dump ************
+// send one line per site over UART0: start address, count, max and the
+// nonzero histogram bins, all times in 12.5ns units or 1us bins
+// waits for UART0, so call it from a thread
+// Inputs: none
+// Outputs: number of sites sent
+uint32_t Crit_Dump(void){
+	CritSiteType site;
+	uint32_t i, j, sent = 0;
+	long sr;
+	UART_OutString("critical sections, max ");
+	UART_OutUDec(CritMaxTime);
+	UART_OutString(" at 0x");
+	UART_OutUHex(CritMaxStart);
+	UART_OutString(", lost ");
+	UART_OutUDec(CritLost);
+	OutCRLF();
+	for (i = 0; i < CRITSITES; i++){
+		sr = StartCritical(); // a consistent copy, printing waits for the UART
+		site = CritSites[i];
+		EndCritical(sr);
+		if (site.Start){
+			UART_OutString("0x");
+			UART_OutUHex(site.Start);
+			UART_OutString(" n ");
+			UART_OutUDec(site.Count);
+			UART_OutString(" max ");
+			UART_OutUDec(site.MaxTime);
+			for (j = 0; j < CRITBINS; j++){
+				if (site.Histogram[j]){
+					UART_OutChar(' ');
+					UART_OutUDec(j);
+					UART_OutChar(':');
+					UART_OutUDec(site.Histogram[j]);
+				}
+			}
+			OutCRLF();
+			sent++;
+		}
+	}
+	return sent;
+}
@@ -0,0 +1,67 @@
+// filename **********critical.h***********
+// Critical section latency profiler for the cube-crusher RTOS
+// With critProfile defined, every StartCritical/EndCritical and
+// OS_DisableInterrupts/OS_EnableInterrupts pair in a file that includes
+// os.h is renamed to a wrapper that times how long interrupts stay masked.
+// Each section is charged to the address it was started from, so a site
+// is one call of StartCritical or OS_DisableInterrupts; look the Start
+// address up in the .map file or the disassembly. Only the outermost
+// section is timed, and only sections closed by a wrapper are counted.
+
+#ifndef _CRITICAL_H_
+#define _CRITICAL_H_
+#include <stdint.h>
+
+//#define critProfile								// Time every critical section, results in CritSites
+
+#define CRITSITES     40            // call sites recorded
+#define CRITBINS      16            // histogram bins of CRITBINTIME, the last one holds everything longer
+#define CRITBINTIME   80            // 1us in 12.5ns units
+
+// one call site
+struct critSite{
+  uint32_t Start;                   // return address of the StartCritical or OS_DisableInterrupts call, 0 if unused
+  uint32_t Count;                   // sections timed
+  uint32_t MaxTime;                 // longest masked time, 12.5ns units
+  uint32_t Histogram[CRITBINS];     // sections by masked time in 1us bins
+};
+typedef struct critSite CritSiteType;
+
+extern CritSiteType CritSites[CRITSITES];
+extern uint32_t CritMaxTime;        // longest masked time of any site, 12.5ns units
+extern uint32_t CritMaxStart;       // Start of the site that masked for CritMaxTime
+extern uint32_t CritLost;           // sections not recorded because every site was in use
+
+// ******** Crit_Reset ************
+// forget every site and start measuring again
+// Inputs: none
+// Outputs: none
+void Crit_Reset(void);
+
+// ******** Crit_Dump ************
+// send one line per site over UART0: start address, count, max and the
+// nonzero histogram bins, all times in 12.5ns units or 1us bins
+// waits for UART0, so call it from a thread
+// Inputs: none
+// Outputs: number of sites sent
+uint32_t Crit_Dump(void);
+
+#ifdef critProfile
+// ******** Crit_StartCritical, Crit_EndCritical ************
+// ******** Crit_DisableInterrupts, Crit_EnableInterrupts ************
+// same as the functions they replace, and time the outermost section
+long Crit_StartCritical(void);
+void Crit_EndCritical(long sr);
+void Crit_DisableInterrupts(void);
+void Crit_EnableInterrupts(void);
+
+// Object-like, so the prototypes each file keeps for these still compile.
+#define StartCritical         Crit_StartCritical
+#define EndCritical           Crit_EndCritical
+#define OS_DisableInterrupts  Crit_DisableInterrupts
+#define OS_EnableInterrupts   Crit_EnableInterrupts
+#define DisableInterrupts     Crit_DisableInterrupts
+#define EnableInterrupts      Crit_EnableInterrupts
+#endif
+
+#endif
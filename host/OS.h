@@ -0,0 +1,3 @@
+// filename **********OS.H***********
+// Main.c includes "OS.h", Linux file names are case sensitive
+#include "../os.h"
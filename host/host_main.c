@@ -0,0 +1,109 @@
+// filename **********host_main.c***********
+// Run the cube game of Main.c on Linux with the host port of os.h
+// Main.c is compiled unchanged as part of this file. Its main() needs the
+// buttons, joystick and microphone, so it is renamed and this one sets up
+// the cube threads the same way, then plays games until every life is lost.
+// A stand-in for button 2 restarts the game until the requested number of
+// games has been played.
+//
+// Build and run from the repository root:
+//   gcc -O2 -Wall -I host -o cubehost host/host_main.c host/os_host.c host/hw_host.c FIFO.c trace.c
+//   ./cubehost [games] [seed] [shuffle]
+// games    games to play, default 10
+// seed     srand() seed for the cube positions, default 1
+// shuffle  nonzero picks a random thread among equal priority ready threads
+//          on every switch, seeded with this value, default 0
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/select.h>
+#include <time.h>
+#include "os_host.h"
+
+#define main TargetMain       // the target main() waits on real hardware
+#define select JoystickSelect // the joystick global clashes with select() from the C library
+#include "../Main.c"
+#undef main
+#undef select
+
+#define HOSTMAXTIME	3600000		// ms of simulated time before giving up
+
+extern unsigned long HostLcdDraws;
+unsigned long Games;         // games finished
+unsigned long GamesWanted;
+unsigned long TotalScore;
+int GameOver;                // the current game ended and button 2 was pushed
+
+// ******** GameWatch ************
+// periodic task, pushes button 2 once a game has ended
+// stops the run after the last game
+static void GameWatch(void){
+	if ((GameOver == 0) && (life == 0) && (spawner_active == false)){
+		GameOver = 1;
+		Games++;
+		TotalScore += score;
+		if (Games >= GamesWanted){
+			HostStopTime = HostTime;
+		}
+		else{
+			OS_HostPushSW2();
+		}
+	}
+	else if (GameOver && spawner_active){
+		GameOver = 0;
+	}
+}
+
+int main(int argc, char *argv[]){
+	struct timespec start, stop;
+	double wall, sim;
+	uint32_t i, j;
+	GamesWanted = (argc > 1) ? strtoul(argv[1], 0, 0) : 10;
+	srand((argc > 2) ? strtoul(argv[2], 0, 0) : 1);
+	HostShuffle = (argc > 3) ? strtoul(argv[3], 0, 0) : 0;
+
+	OS_Init();
+	Device_Init();
+	OS_InitSemaphore(&scoreFree, 1);
+	OS_InitSemaphore(&lifeFree, 1);
+	OS_InitSemaphore(&cubesLeftFree, 1);
+	OS_NameSemaphore(&scoreFree, "scoreFree");
+	OS_NameSemaphore(&lifeFree, "lifeFree");
+	OS_NameSemaphore(&cubesLeftFree, "cubesLeftFree");
+	OS_InitEventFlags(&GameEvents, 0);
+	for (i=0; i<NUMCUBES; i++){
+		OS_InitSemaphore(&(CubeArray[i].CubeFree), 1);
+		IndexName(CubeFreeName[i], "CubeFree", 0, i);
+		OS_NameSemaphore(&(CubeArray[i].CubeFree), CubeFreeName[i]);
+	}
+	for (i=0; i<HORIZONTALNUM; i++){
+		for (j=0; j<VERTICALNUM; j++){
+			OS_InitSemaphore(&(BlockArray[j][i].BlockFree), 1);
+			IndexName(BlockFreeName[j][i], "BlockFree", j, i);
+			OS_NameSemaphore(&(BlockArray[j][i].BlockFree), BlockFreeName[j][i]);
+		}
+	}
+	game_started = true;
+	OS_AddSW2Task(&SW2Push, 4);
+	OS_AddPeriodicThread(&GameWatch, TIME_1MS, 0);
+#ifdef CUBEPOOL
+	OS_InitThreadPool(NUMCUBES, 400, 1);
+#endif
+	OS_AddThread(&CubeSpawner, 400, 2);
+
+	OS_HostRunFor(HOSTMAXTIME);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	OS_Launch(TIME_2MS);
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	wall = (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec)/1e9;
+	sim = HostTime/(double)TIME_1MS;
+	printf("games %lu, total score %lu\n", Games, TotalScore);
+	printf("waves %lu, cubes %lu, spawn latency max %lu avg %lu (12.5ns)\n",
+		SpawnerPasses, SpawnCount, SpawnMaxTime, SpawnCount ? SpawnTotalTime/SpawnCount : 0);
+	printf("simulated %.0f ms in %.3f s, %.0f ticks/s\n", sim, wall, wall > 0 ? sim/wall : 0);
+	printf("switches %llu, clock skips %llu, LCD calls %lu\n",
+		(unsigned long long)HostSwitches, (unsigned long long)HostSkips, HostLcdDraws);
+	printf("cpu load %lu.%lu%% over the last 5 s\n", OS_CpuLoad(5000)/10, OS_CpuLoad(5000)%10);
+	return (Games >= GamesWanted) ? 0 : 1;
+}
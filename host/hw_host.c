@@ -0,0 +1,60 @@
+// filename **********hw_host.c***********
+// Stand-ins for the LaunchPad and BoosterPack drivers used by Main.c,
+// so it links on Linux with os_host.c. Drawing only counts calls, the
+// joystick stays centered and UART0 output is thrown away.
+
+#include <stdint.h>
+#include "../os.h"
+#include "../LCD.h"
+#include "../joystick.h"
+#include "../UART.h"
+
+MutexType LCDFree;            // defined in LCD.c on the target
+unsigned long HostLcdDraws;   // number of LCD calls Main.c made
+
+void BSP_LCD_OutputInit(void){
+	OS_InitMutex(&LCDFree);
+}
+
+void BSP_LCD_FillScreen(uint16_t color){
+	(void)color;
+	HostLcdDraws++;
+}
+
+uint32_t BSP_LCD_DrawString(uint16_t x, uint16_t y, char *pt, int16_t textColor){
+	(void)x; (void)y; (void)pt; (void)textColor;
+	HostLcdDraws++;
+	return 0;
+}
+
+void BSP_LCD_Message (int device, int line, int col, char *string, unsigned int value){
+	(void)device; (void)line; (void)col; (void)string; (void)value;
+	HostLcdDraws++;
+}
+
+void BSP_LCD_DrawCrosshair(int16_t x, int16_t y, int16_t bgColor){
+	(void)x; (void)y; (void)bgColor;
+	HostLcdDraws++;
+}
+
+void BSP_LCD_Cube(int16_t x, int16_t y, int16_t size, int16_t color){
+	(void)x; (void)y; (void)size; (void)color;
+	HostLcdDraws++;
+}
+
+void BSP_Joystick_Init(void){
+}
+
+void BSP_Joystick_Input(uint16_t *x, uint16_t *y, uint8_t *select){
+	*x = 512;    // centered
+	*y = 512;
+	*select = 1; // not pressed
+}
+
+void UART_Init(void){
+}
+
+int UART_TryOutChar(char data){
+	(void)data;
+	return 1;
+}
@@ -0,0 +1,1474 @@
+// filename **********os_host.c***********
+// Linux port of the os.h API, so game and kernel logic can run off-target
+// This is a simulator, not os.c: os.c switches threads in PendSV and reads
+// the timers directly, so it cannot run here. The scheduling rules below are
+// written again to match os.c and must be changed together with it. Only the
+// game code in Main.c is shared; kernel bugs found here must be checked in os.c.
+// Threads are ucontext_t contexts switched on one Linux thread. There are no
+// timers: time is simulated in the same 12.5ns units as OS_Time(). Every OS
+// call costs APICOST, and the clock jumps to the next tick, periodic task or
+// wakeup whenever nothing can make progress before it. That happens when no
+// thread is ready, or when every ready thread at the top priority has called
+// OS_Suspend since the clock last moved (the polling loops in Main.c only
+// look at OS_MsTime, so they see nothing new until the next tick). A thread
+// that spins without any OS call for SPINLIMIT periods of CPU time, counted
+// by SIGVTALRM, is charged a whole time slice and yields at its next OS call.
+// The handler only counts, switching there is not async-signal-safe. After
+// SPINHANG periods with no OS call the run stops, nothing else could run.
+// Scheduling is priority with round robin and the same aging as os.c: a
+// ready thread gains one level every 9ms and drops back when it is chosen.
+// A mutex raises its owner, and the owners down a chain of mutex waits, to
+// the priority of a waiter. Unlocking keeps what other held mutexes still
+// pass on, as MutexRelease() in os.c does.
+// Threads from OS_AddDeadlineThread run at priority 0 earliest deadline
+// first, with the admission test of edfSched in os.c.
+// Periodic and one-shot timers run between OS calls, never in the middle of
+// one, on the same OS_TIMERTICK grid as the timer wheel of os.c.
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include "../os.h"
+#include "os_host.h"
+
+#ifndef semaStats
+#error "os_host.c always keeps lock statistics, define semaStats in os.h"
+#endif
+
+#define NUMTHREADS	20					// Maximum number of threads, same as os.c
+#define IDINDEX(id)	((id) & 0xFF)		// tcbs index of a thread ID, same as os.c
+#define NUMPERIODIC	8						// Timers kept for OS_AddPeriodicThread, same as os.c
+#define HOSTSTACKSIZE	65536			// C library calls need more stack than the target threads
+#define APICOST	80							// 12.5ns units charged per OS call, about 1us
+#define DELAYCOST	400000				// 12.5ns units per delay() count, 5ms like the target loop
+#define SPINLIMIT	2							// SIGVTALRM periods without an OS call before yielding at the next one
+#define SPINHANG	500							// SIGVTALRM periods without an OS call before giving up, 5s
+#define SPINPERIOD	10000				// us of CPU time between SIGVTALRM
+#define JOBQUEUESIZE	16					// Pending jobs, must be a power of 2
+#define RTUTILMAX	1000000				// admission limit on the sum of wcet/period, parts per million
+#define CPULOADSLOTMS	100					// OS_CpuLoad slot, same as os.c
+#define CPULOADSLOTS	50					// slots kept, same as os.c
+
+#define READY	0
+#define SLEEPING	1
+#define BLOCKED	2
+
+struct tcb{
+	ucontext_t ctx;         // saved registers and signal mask
+	char *stack;            // HOSTSTACKSIZE bytes, kept when the thread is killed
+	struct tcb *nextBlocked;// next thread on the same semaphore, mutex or flag group
+	unsigned long id;       // index into tcbs plus 256 times the threads this TCB has held
+	int available;          // 1 if this TCB is free
+	int state;              // READY, SLEEPING or BLOCKED
+	int yielded;            // called OS_Suspend since the clock last moved
+	uint32_t priority;      // working priority, raised by aging
+	uint32_t basePriority;  // fixedPriority or the priority inherited through a mutex
+	uint32_t fixedPriority; // priority given to OS_AddThread
+	uint32_t age;           // ms spent ready since the last aging step
+	uint64_t wakeTime;      // HostTime to leave SLEEPING
+	uint32_t waitFlags;     // event flags waited for, then the flags that ended the wait
+	uint32_t waitMode;      // OS_FLAGS_ANY or OS_FLAGS_ALL, plus OS_FLAGS_CLEAR
+	struct tcb **waitList;  // list of a message queue or timed semaphore wait, SLEEPING if it has a timeout
+	MutexType *waitMutex;   // mutex it is blocked on, 0 if none
+	MutexType *heldList;    // mutexes it owns, linked through NextHeld
+	Sema4Type *waitSema;    // semaphore of a timed wait
+	void *waitMsg;          // message to send, or place for the message to receive
+	int timedOut;           // 1 if the last timed wait ran out
+	uint32_t notifyValue;   // bits from OS_Notify not yet taken by OS_NotifyWait
+	uint32_t notifyWait;    // mask given to OS_NotifyWait while blocked in it, 0 if not
+	void (*task)(void);     // entry point
+	uint32_t ExecCount;     // number of times switched to
+	uint64_t RunTime;       // simulated 12.5ns units spent running
+	uint32_t period;        // ms between releases, 0 for a thread without a deadline
+	uint32_t wcet;          // CPU budget per job in 12.5ns units
+	uint32_t utilization;   // wcet/period in parts per million
+	uint64_t deadline;      // ms since OS_Init the current job must finish by
+	uint64_t jobStart;      // RunTime when the current job was released
+	uint32_t DeadlineMisses;// jobs that ended late or never ran
+	uint32_t BudgetOverruns;// jobs that used more than wcet
+};
+typedef struct tcb tcbType;
+
+tcbType tcbs[NUMTHREADS];
+tcbType *RunPt;
+static tcbType *DeadPt;     // killed thread still on its own stack
+static ucontext_t HostMainCtx;
+static int Launched;
+
+uint64_t HostTime;
+uint64_t HostStopTime = UINT64_MAX;
+uint64_t HostSwitches;
+uint64_t HostSkips;
+uint32_t HostShuffle;
+static uint64_t MsBase;     // HostTime of the last OS_ClearMsTime
+static uint64_t NextAge;    // HostTime of the next 1ms aging step
+static uint64_t SliceStart; // HostTime when RunPt got the CPU
+static uint64_t TimeSlice = TIME_2MS;
+static int Critical;        // nesting of OS calls, switches only happen at depth 1
+static int IntMasked;       // OS_DisableInterrupts or StartCritical in effect
+static int NeedSwitch;      // a higher priority thread woke or the slice ran out
+static int InTick;
+static uint32_t RtUtilization; // sum of wcet/period of the deadline threads, parts per million
+static uint32_t RtThreads;     // deadline threads alive, aging stops at priority 1 while there are any
+static volatile sig_atomic_t SpinCount; // SIGVTALRM periods since the last OS call
+static uint64_t IdleSlot;      // HostTime spent with nothing ready in the current OS_CpuLoad slot
+static uint64_t NextSlot;      // HostTime the current slot ends
+static uint32_t IdleHistory[CPULOADSLOTS]; // idle time of the last slots, IdleSlots%CPULOADSLOTS is the oldest
+static uint32_t IdleSlots;     // slots finished since OS_Launch
+
+static TimerType *TimerList;            // running timers, in no particular order
+static TimerType PeriodicTimers[NUMPERIODIC];
+static int NumPeriodic;
+static void (*SW1Task)(void);
+static void (*SW2Task)(void);
+
+// ******** ShuffleRand ************
+// xorshift generator for HostShuffle, separate from rand() used by the game
+static uint32_t ShuffleRand(void){
+	HostShuffle ^= HostShuffle << 13;
+	HostShuffle ^= HostShuffle >> 17;
+	HostShuffle ^= HostShuffle << 5;
+	return HostShuffle;
+}
+
+// ******** Wake ************
+// make a thread ready, ask for a switch if it outranks RunPt
+static void Wake(tcbType *pt){
+	pt->state = READY;
+	if ((RunPt == 0) || (RunPt->state != READY) || (pt->priority < RunPt->priority)){
+		NeedSwitch = 1;
+	}
+	else if (pt->period && RunPt->period && (pt->priority == RunPt->priority) && (pt->deadline < RunPt->deadline)){
+		NeedSwitch = 1; // earlier deadline preempts
+	}
+}
+
+// ******** WaitRemove ************
+// unlink a given thread from a wait list
+static void WaitRemove(tcbType **list, tcbType *pt){
+	while ((*list) && (*list != pt)){
+		list = &(*list)->nextBlocked;
+	}
+	if (*list){
+		*list = pt->nextBlocked;
+	}
+}
+
+// ******** TimerUnlink ************
+static void TimerUnlink(TimerType *timerPt){
+	*timerPt->Link = timerPt->Next;
+	if (timerPt->Next){
+		timerPt->Next->Link = timerPt->Link;
+	}
+}
+
+// ******** TimerDue ************
+// the timer that is due first, highest priority among equals, 0 if none is due
+static TimerType *TimerDue(void){
+	uint32_t now = (uint32_t)(HostTime/OS_TIMERTICK);
+	TimerType *pt, *best = 0;
+	for (pt = TimerList; pt; pt = pt->Next){
+		if (((int32_t)(pt->Expires - now) <= 0) && ((best == 0) ||
+		   ((int32_t)(pt->Expires - best->Expires) < 0) ||
+		   ((pt->Expires == best->Expires) && (pt->Priority < best->Priority)))){
+			best = pt;
+		}
+	}
+	return best;
+}
+
+// ******** SlotClose ************
+// move the current OS_CpuLoad slot into IdleHistory and start the next
+static void SlotClose(void){
+	IdleHistory[IdleSlots%CPULOADSLOTS] = (uint32_t)IdleSlot;
+	IdleSlots++;
+	IdleSlot = 0;
+	NextSlot += CPULOADSLOTMS*TIME_1MS;
+}
+
+// ******** IdleCharge ************
+// add the HostTime from..to spent with nothing ready, split at slot boundaries
+static void IdleCharge(uint64_t from, uint64_t to){
+	while (to >= NextSlot){
+		if (from < NextSlot){
+			IdleSlot += NextSlot - from;
+			from = NextSlot; // the rest goes to the next slot
+		}
+		SlotClose();
+	}
+	IdleSlot += to - from;
+}
+
+// ******** Tick ************
+// run periodic tasks that are due and wake threads whose sleep is over
+static void Tick(void){
+	TimerType *timerPt;
+	int i;
+	if (InTick){
+		return;
+	}
+	InTick = 1;
+	while (NextSlot <= HostTime){ // close the OS_CpuLoad slots that have passed
+		SlotClose();
+	}
+	while ((timerPt = TimerDue())){
+		if (timerPt->Period){
+			timerPt->Expires += timerPt->Period;
+		}
+		else{
+			TimerUnlink(timerPt);
+			timerPt->Active = 0;
+		}
+		timerPt->Runs++;
+		timerPt->Task();
+	}
+	for (i = 0; i < NUMTHREADS; i++){
+		if ((tcbs[i].available == 0) && (tcbs[i].state == SLEEPING) && (tcbs[i].wakeTime <= HostTime)){
+			if (tcbs[i].waitList){ // a timed wait ran out
+				WaitRemove(tcbs[i].waitList, &tcbs[i]);
+				tcbs[i].waitList = 0;
+				tcbs[i].timedOut = 1;
+				if (tcbs[i].waitSema){ // give back the count it took
+					tcbs[i].waitSema->Value++;
+					tcbs[i].waitSema->Timeouts++;
+					tcbs[i].waitSema = 0;
+				}
+			}
+			Wake(&tcbs[i]);
+		}
+	}
+	while (NextAge <= HostTime){ // Timer2A_Handler ages ready threads every 1ms
+		NextAge += TIME_1MS;
+		for (i = 0; i < NUMTHREADS; i++){
+			if ((tcbs[i].available == 0) && (tcbs[i].state == READY)){
+				tcbs[i].age++;
+				if ((tcbs[i].age > 8) && (tcbs[i].priority > (RtThreads ? 1u : 0u))){
+					tcbs[i].age = 0;
+					tcbs[i].priority--;
+					Wake(&tcbs[i]);
+				}
+			}
+		}
+	}
+	if (HostTime - SliceStart >= TimeSlice){
+		NeedSwitch = 1;
+	}
+	InTick = 0;
+}
+
+// ******** NextEvent ************
+// HostTime of the next tick, periodic task or wakeup
+static uint64_t NextEvent(void){
+	uint64_t next = HostTime + TIME_1MS - (HostTime - MsBase) % TIME_1MS;
+	int i;
+	uint64_t tick = HostTime/OS_TIMERTICK;
+	TimerType *pt;
+	for (pt = TimerList; pt; pt = pt->Next){
+		if ((tick + (int32_t)(pt->Expires - (uint32_t)tick))*OS_TIMERTICK < next){
+			next = (tick + (int32_t)(pt->Expires - (uint32_t)tick))*OS_TIMERTICK;
+		}
+	}
+	for (i = 0; i < NUMTHREADS; i++){
+		if ((tcbs[i].available == 0) && (tcbs[i].state == SLEEPING) && (tcbs[i].wakeTime < next)){
+			next = tcbs[i].wakeTime;
+		}
+	}
+	return next;
+}
+
+// ******** Stuck ************
+// 1 if nothing is ready and nothing can ever wake a thread
+static int Stuck(void){
+	int i;
+	if (TimerList){
+		return 0;
+	}
+	for (i = 0; i < NUMTHREADS; i++){
+		if ((tcbs[i].available == 0) && (tcbs[i].state != BLOCKED)){
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// ******** Pick ************
+// highest priority ready thread that has not yielded, round robin after RunPt
+// returns 0 if every ready thread at the top priority has yielded
+static tcbType *Pick(void){
+	tcbType *pt, *best = 0;
+	uint32_t top = UINT32_MAX;
+	int i, start, n = 0;
+	for (i = 0; i < NUMTHREADS; i++){
+		if ((tcbs[i].available == 0) && (tcbs[i].state == READY) && (tcbs[i].priority < top)){
+			top = tcbs[i].priority;
+		}
+	}
+	start = RunPt ? (int)(IDINDEX(RunPt->id) + 1) : 0;
+	for (i = 0; i < NUMTHREADS; i++){
+		pt = &tcbs[(start + i) % NUMTHREADS];
+		if (pt->available || (pt->state != READY) || (pt->priority != top) || pt->yielded){
+			continue;
+		}
+		if (pt->period){ // threads without a deadline first, then earliest deadline
+			if ((best == 0) || (best->period && (pt->deadline < best->deadline))){
+				best = pt;
+			}
+			continue;
+		}
+		n++;
+		if ((best == 0) || best->period){
+			best = pt;
+			if (HostShuffle == 0){
+				break;
+			}
+		}
+		else if (ShuffleRand() % n == 0){
+			best = pt;
+		}
+	}
+	return best;
+}
+
+// ******** Switch ************
+// give the CPU to the best thread, called with Critical == 1
+// returns when RunPt runs again
+static void Switch(void){
+	tcbType *old = RunPt, *next;
+	uint64_t idleFrom;
+	int i, skipped;
+	NeedSwitch = 0;
+	for (;;){
+		if (HostTime >= HostStopTime){
+			Launched = 0;
+			setcontext(&HostMainCtx); // run is over, OS_Launch returns
+		}
+		next = Pick();
+		if (next){
+			break;
+		}
+		skipped = 0;
+		for (i = 0; i < NUMTHREADS; i++){
+			if (tcbs[i].yielded){
+				tcbs[i].yielded = 0;
+				skipped = 1;
+			}
+		}
+		if (skipped){
+			HostSkips++;
+			next = Pick();
+			if (next){
+				HostTime = NextEvent(); // pollers only see something new after the next event
+				Tick();
+				NeedSwitch = 0;
+				next = Pick(); // a periodic task may have woken a better thread
+				break;
+			}
+		}
+		if (Stuck()){
+			Launched = 0;
+			setcontext(&HostMainCtx); // deadlock or every thread is dead
+		}
+		idleFrom = HostTime;
+		HostTime = NextEvent(); // nothing is ready, idle until something happens
+		IdleCharge(idleFrom, HostTime); // the target would be in its idle thread
+		Tick();
+	}
+	SliceStart = HostTime;
+	next->priority = next->basePriority; // aging boost is used up
+	if (next != old){
+		RunPt = next;
+		next->ExecCount++;
+		HostSwitches++;
+		swapcontext(&old->ctx, &next->ctx);
+	}
+	if (DeadPt && (DeadPt != RunPt)){ // its stack is no longer in use
+		DeadPt->available = 1;
+		DeadPt = 0;
+	}
+}
+
+// ******** Enter ************
+// start of every OS call: charge its cost and catch up with the clock
+static void Enter(void){
+	Critical++;
+	if ((SpinCount >= SPINLIMIT) && RunPt && (Critical == 1)){ // it spun, let its peers run and the clock move
+		HostTime += TimeSlice;
+		RunPt->RunTime += TimeSlice;
+		RunPt->yielded = 1;
+		NeedSwitch = 1;
+	}
+	SpinCount = 0;
+	HostTime += APICOST;
+	if (RunPt){
+		RunPt->RunTime += APICOST;
+	}
+	Tick();
+}
+
+// ******** Leave ************
+// end of every OS call, switch if something better became ready
+static void Leave(void){
+	if ((Critical == 1) && NeedSwitch && Launched && (IntMasked == 0)){
+		Switch();
+	}
+	Critical--;
+}
+
+// ******** Block ************
+// RunPt has been put on a list, run something else until it is woken
+static void Block(int state){
+	RunPt->state = state;
+	Switch();
+}
+
+// ******** SpinCheck ************
+// SIGVTALRM, count CPU time spent without any OS call, Enter() acts on it
+// a thread that never makes one again cannot be preempted, so stop the run
+static void SpinCheck(int sig){
+	static const char msg[] = "os_host: a thread spins without OS calls, nothing else can run\n";
+	(void)sig;
+	if ((Launched == 0) || Critical || (RunPt == 0)){
+		return;
+	}
+	if (++SpinCount >= SPINHANG){
+		(void)write(2, msg, sizeof(msg) - 1);
+		_exit(2);
+	}
+}
+
+static void ThreadStart(void){
+	if (DeadPt && (DeadPt != RunPt)){
+		DeadPt->available = 1;
+		DeadPt = 0;
+	}
+	Critical = 0;
+	RunPt->task();
+	OS_Kill(); // returning from a thread is a crash on the target, here it just ends
+}
+
+// ******** BlockInsert ************
+// add to a wait list, highest priority first, FIFO within a priority
+static void BlockInsert(tcbType **list, tcbType *pt){
+	while ((*list) && ((*list)->priority <= pt->priority)){
+		list = &(*list)->nextBlocked;
+	}
+	pt->nextBlocked = *list;
+	*list = pt;
+}
+
+static tcbType *BlockRemove(tcbType **list){
+	tcbType *pt = *list;
+	*list = pt->nextBlocked;
+	pt->nextBlocked = 0;
+	pt->waitList = 0;
+	pt->waitSema = 0;
+	return pt;
+}
+
+void OS_DisableInterrupts(void){
+	IntMasked = 1;
+}
+
+void OS_EnableInterrupts(void){
+	IntMasked = 0;
+	if ((Critical == 0) && NeedSwitch && Launched){
+		Critical = 1;
+		Switch();
+		Critical = 0;
+	}
+}
+
+long StartCritical(void){
+	long sr = IntMasked;
+	IntMasked = 1;
+	return sr;
+}
+
+void EndCritical(long sr){
+	if (sr == 0){
+		OS_EnableInterrupts();
+	}
+}
+
+void OS_Init(void){
+	int i;
+	for (i = 0; i < NUMTHREADS; i++){
+		tcbs[i].available = 1;
+		tcbs[i].id = i;
+	}
+	RunPt = 0;
+	DeadPt = 0;
+	HostTime = MsBase = SliceStart = 0;
+	NextAge = TIME_1MS;
+	HostSwitches = HostSkips = 0;
+	TimerList = 0;
+	NumPeriodic = 0;
+	RtUtilization = RtThreads = 0;
+	IdleSlot = IdleSlots = 0;
+	Critical = 0;
+	IntMasked = 1; // like the target, interrupts stay off until OS_Launch
+}
+
+int OS_AddThread(void(*task)(void), unsigned long stackSize, unsigned long priority){
+	tcbType *pt = 0;
+	int i;
+	(void)stackSize; // every host thread gets HOSTSTACKSIZE
+	for (i = 0; i < NUMTHREADS; i++){
+		if (tcbs[i].available){
+			pt = &tcbs[i];
+			break;
+		}
+	}
+	if (pt == 0){
+		return 0;
+	}
+	if (pt->stack == 0){
+		pt->stack = malloc(HOSTSTACKSIZE);
+		if (pt->stack == 0){
+			return 0;
+		}
+	}
+	getcontext(&pt->ctx);
+	pt->ctx.uc_stack.ss_sp = pt->stack;
+	pt->ctx.uc_stack.ss_size = HOSTSTACKSIZE;
+	pt->ctx.uc_link = 0;
+	sigemptyset(&pt->ctx.uc_sigmask);
+	makecontext(&pt->ctx, ThreadStart, 0);
+	pt->id = (pt->id & ~0xFFul) + 0x100 + i; // a stale ID of the last thread here no longer matches
+	pt->available = 0;
+	pt->state = READY;
+	pt->yielded = 0;
+	pt->priority = pt->basePriority = pt->fixedPriority = priority;
+	pt->age = 0;
+	pt->nextBlocked = 0;
+	pt->waitList = 0;
+	pt->waitMutex = 0;
+	pt->heldList = 0;
+	pt->waitSema = 0;
+	pt->timedOut = 0;
+	pt->notifyValue = pt->notifyWait = 0;
+	pt->task = task;
+	pt->ExecCount = 0;
+	pt->RunTime = 0;
+	pt->period = pt->wcet = pt->utilization = 0;
+	pt->deadline = pt->jobStart = 0;
+	pt->DeadlineMisses = pt->BudgetOverruns = 0;
+	if (Launched){
+		Critical++;
+		Wake(pt);
+		Leave();
+	}
+	return 1;
+}
+
+int OS_AddDeadlineThread(void(*task)(void), unsigned long stackSize, unsigned long period, unsigned long wcet){
+	uint32_t periodMs = (period + TIME_1MS/2)/TIME_1MS;
+	uint32_t utilization;
+	tcbType *pt;
+	int i;
+	if (periodMs == 0){
+		periodMs = 1;
+	}
+	utilization = (uint32_t)(((uint64_t)wcet*1000000 + (uint64_t)periodMs*TIME_1MS - 1)/((uint64_t)periodMs*TIME_1MS));
+	if ((utilization > RTUTILMAX) || (RtUtilization + utilization > RTUTILMAX)){
+		return 0;
+	}
+	for (i = 0; i < NUMTHREADS; i++){
+		if (tcbs[i].available){
+			break;
+		}
+	}
+	if ((i == NUMTHREADS) || (OS_AddThread(task, stackSize, 0) == 0)){
+		return 0;
+	}
+	pt = &tcbs[i]; // the TCB OS_AddThread just took
+	pt->period = periodMs;
+	pt->wcet = wcet;
+	pt->utilization = utilization;
+	pt->deadline = HostTime/TIME_1MS + periodMs;
+	RtUtilization += utilization;
+	RtThreads++;
+	return 1;
+}
+
+void OS_WaitPeriod(void){
+	uint64_t now, release;
+	if (RunPt->period == 0){
+		OS_Suspend();
+		return;
+	}
+	Enter();
+	now = HostTime/TIME_1MS;
+	if (now > RunPt->deadline){
+		RunPt->DeadlineMisses++;
+	}
+	if (RunPt->RunTime - RunPt->jobStart > RunPt->wcet){
+		RunPt->BudgetOverruns++;
+	}
+	RunPt->jobStart = RunPt->RunTime;
+	release = RunPt->deadline;
+	while (now >= release + RunPt->period){ // that job never started
+		release += RunPt->period;
+		RunPt->DeadlineMisses++;
+	}
+	RunPt->deadline = release + RunPt->period;
+	if (release > now){
+		RunPt->wakeTime = release*TIME_1MS;
+		Block(SLEEPING);
+	}
+	else{
+		Switch(); // released already, compete with the new deadline
+	}
+	Leave();
+}
+
+unsigned long OS_Id(void){
+	return RunPt->id;
+}
+
+void OS_IsrEnter(void){
+}
+
+void OS_IsrExit(void){
+}
+
+unsigned long OS_GetThreadStats(ThreadStatsType *stats, unsigned long max){
+	unsigned long n = 0;
+	int i;
+	for (i = 0; (i < NUMTHREADS) && (n < max); i++){
+		if (tcbs[i].available == 0){
+			stats[n].Id = tcbs[i].id;
+			stats[n].Task = tcbs[i].task;
+			stats[n].Priority = tcbs[i].fixedPriority;
+			stats[n].ExecCount = tcbs[i].ExecCount;
+			stats[n].RunTime = tcbs[i].RunTime;
+			stats[n].IsrTime = 0;
+			stats[n].DeadlineMisses = tcbs[i].DeadlineMisses;
+			stats[n].BudgetOverruns = tcbs[i].BudgetOverruns;
+			n++;
+		}
+	}
+	return n;
+}
+
+long OS_CheckThreads(void){
+	long live = 0;
+	int i;
+	for (i = 0; i < NUMTHREADS; i++){ // the host keeps no ring, count what Pick() would see
+		if ((tcbs[i].available == 0) && (&tcbs[i] != DeadPt)){
+			live++;
+		}
+	}
+	return live;
+}
+
+unsigned long OS_StackUsage(unsigned long id){
+	(void)id;
+	return 0; // host stacks are not painted
+}
+
+// ******** WaitTimed ************
+// block RunPt on a wait list, with a timeout unless OS_WAIT_FOREVER
+static void WaitTimed(tcbType **list, unsigned long timeout){
+	BlockInsert(list, RunPt);
+	RunPt->waitList = list;
+	RunPt->timedOut = 0;
+	if (timeout == OS_WAIT_FOREVER){
+		Block(BLOCKED);
+	}
+	else{
+		RunPt->wakeTime = HostTime + (uint64_t)timeout*TIME_1MS;
+		Block(SLEEPING);
+	}
+}
+
+// ******** WaitWake ************
+// take the first thread off a message queue list, list must not be empty
+static tcbType *WaitWake(tcbType **list){
+	tcbType *pt = BlockRemove(list);
+	Wake(pt);
+	return pt;
+}
+
+// lock statistics, same list and counters as semaStats in os.c
+static LockStatsType *LockList;
+
+static void LockClear(LockStatsType *statsPt){
+	statsPt->Acquisitions = 0;
+	statsPt->Contended = 0;
+	statsPt->Failed = 0;
+	statsPt->WaitMax = 0;
+	statsPt->WaitTotal = 0;
+}
+
+static void LockRegister(LockStatsType *statsPt){
+	LockStatsType *pt;
+	LockClear(statsPt);
+	for (pt = LockList; pt; pt = pt->Next){
+		if (pt == statsPt){
+			return;
+		}
+	}
+	statsPt->Next = LockList;
+	LockList = statsPt;
+}
+
+static void LockWaited(LockStatsType *statsPt, uint32_t start, int took){
+	uint32_t wait = OS_TimeDifference(start, OS_Time());
+	statsPt->WaitTotal += wait;
+	if (wait > statsPt->WaitMax){
+		statsPt->WaitMax = wait;
+	}
+	if (took){
+		statsPt->Acquisitions++;
+		statsPt->Contended++;
+	}
+	else{
+		statsPt->Failed++;
+	}
+}
+
+void OS_NameSemaphore(Sema4Type *semaPt, const char *name){
+	semaPt->Stats.Name = name;
+}
+
+void OS_NameMutex(MutexType *mutexPt, const char *name){
+	mutexPt->Stats.Name = name;
+}
+
+LockStatsType *OS_NextLock(LockStatsType *statsPt){
+	return statsPt ? statsPt->Next : LockList;
+}
+
+void OS_ClearLockStats(void){
+	LockStatsType *pt;
+	for (pt = LockList; pt; pt = pt->Next){
+		LockClear(pt);
+	}
+}
+
+void OS_InitSemaphore(Sema4Type *semaPt, long value){
+	semaPt->Value = value;
+	semaPt->BlockedList = 0;
+	semaPt->Timeouts = 0;
+	LockRegister(&semaPt->Stats);
+}
+
+void OS_Wait(Sema4Type *semaPt){
+	uint32_t start;
+	Enter();
+	semaPt->Value -= 1;
+	if (semaPt->Value < 0){
+		start = OS_Time();
+		BlockInsert(&semaPt->BlockedList, RunPt);
+		Block(BLOCKED);
+		LockWaited(&semaPt->Stats, start, 1);
+	}
+	else{
+		semaPt->Stats.Acquisitions++;
+	}
+	Leave();
+}
+
+void OS_Signal(Sema4Type *semaPt){
+	Enter();
+	semaPt->Value += 1;
+	if (semaPt->Value <= 0){
+		Wake(BlockRemove(&semaPt->BlockedList));
+	}
+	Leave();
+}
+
+void OS_bWait(Sema4Type *semaPt){
+	OS_Wait(semaPt);
+}
+
+void OS_bSignal(Sema4Type *semaPt){
+	Enter();
+	semaPt->Value += 1;
+	if (semaPt->Value > 1){
+		semaPt->Value = 1;
+	}
+	if (semaPt->Value <= 0){
+		Wake(BlockRemove(&semaPt->BlockedList));
+	}
+	Leave();
+}
+
+int OS_WaitTimeout(Sema4Type *semaPt, unsigned long timeout){
+	int got = 1;
+	uint32_t start;
+	Enter();
+	if (semaPt->Value > 0){
+		semaPt->Value -= 1;
+		semaPt->Stats.Acquisitions++;
+	}
+	else if (timeout == OS_NO_WAIT){
+		semaPt->Timeouts++;
+		semaPt->Stats.Failed++;
+		got = 0;
+	}
+	else{
+		semaPt->Value -= 1;
+		start = OS_Time();
+		RunPt->waitSema = semaPt;
+		WaitTimed(&semaPt->BlockedList, timeout); // Tick gives the count back if it runs out
+		got = !RunPt->timedOut;
+		LockWaited(&semaPt->Stats, start, got);
+	}
+	Leave();
+	return got;
+}
+
+int OS_bWaitTimeout(Sema4Type *semaPt, unsigned long timeout){
+	return OS_WaitTimeout(semaPt, timeout);
+}
+
+uint16_t OS_bTry(Sema4Type *semaPt){
+	uint16_t got = 0;
+	Enter();
+	if (semaPt->Value > 0){
+		semaPt->Value = 0;
+		semaPt->Stats.Acquisitions++;
+		got = 1;
+	}
+	else{
+		semaPt->Stats.Failed++;
+	}
+	Leave();
+	return got;
+}
+
+void OS_InitMutex(MutexType *mutexPt){
+	mutexPt->Owner = 0;
+	mutexPt->BlockedList = 0;
+	mutexPt->NextHeld = 0;
+	mutexPt->LockTime = 0;
+	mutexPt->MaxHold = 0;
+	mutexPt->Inherits = 0;
+	mutexPt->BadUnlocks = 0;
+	LockRegister(&mutexPt->Stats);
+}
+
+// ******** ChangePriority ************
+// set the working priority of a thread and keep the mutex or wait list it is on in order
+static void ChangePriority(tcbType *pt, uint32_t priority){
+	if (pt->waitMutex){
+		WaitRemove(&pt->waitMutex->BlockedList, pt);
+		pt->priority = priority;
+		BlockInsert(&pt->waitMutex->BlockedList, pt);
+	}
+	else if (pt->waitList){
+		WaitRemove(pt->waitList, pt);
+		pt->priority = priority;
+		BlockInsert(pt->waitList, pt);
+	}
+	else{
+		pt->priority = priority;
+		if (pt->state == READY){
+			NeedSwitch = 1; // it may outrank RunPt now, or RunPt lost its boost
+		}
+	}
+}
+
+// ******** MutexTake ************
+static void MutexTake(MutexType *mutexPt, tcbType *pt){
+	mutexPt->Owner = pt;
+	mutexPt->NextHeld = pt->heldList;
+	pt->heldList = mutexPt;
+	mutexPt->LockTime = (uint32_t)HostTime;
+}
+
+void OS_MutexLock(MutexType *mutexPt){
+	uint32_t start, priority;
+	MutexType *m;
+	tcbType *owner;
+	Enter();
+	if (mutexPt->Owner == 0){
+		MutexTake(mutexPt, RunPt);
+		mutexPt->Stats.Acquisitions++;
+	}
+	else{
+		start = OS_Time();
+		priority = RunPt->priority;
+		for (m = mutexPt; m; m = owner->waitMutex){ // pass the priority down the chain of owners
+			owner = m->Owner;
+			if (owner->basePriority <= priority){
+				break;
+			}
+			owner->basePriority = priority;
+			if (owner->priority > priority){
+				ChangePriority(owner, priority);
+			}
+			m->Inherits++;
+		}
+		BlockInsert(&mutexPt->BlockedList, RunPt);
+		RunPt->waitMutex = mutexPt;
+		Block(BLOCKED); // MutexRelease makes us the owner
+		LockWaited(&mutexPt->Stats, start, 1);
+	}
+	Leave();
+}
+
+// ******** MutexRelease ************
+// take a mutex from its owner, keep only the priority its other mutexes
+// pass on and hand it to the highest priority waiter
+static void MutexRelease(MutexType *mutexPt){
+	MutexType **link;
+	MutexType *m;
+	tcbType *pt = mutexPt->Owner;
+	uint32_t priority;
+	link = &pt->heldList;
+	while ((*link) && (*link != mutexPt)){
+		link = &(*link)->NextHeld;
+	}
+	if (*link){
+		*link = mutexPt->NextHeld;
+	}
+	priority = pt->fixedPriority; // highest priority still waiting on what it holds
+	for (m = pt->heldList; m; m = m->NextHeld){
+		if (m->BlockedList && (m->BlockedList->priority < priority)){
+			priority = m->BlockedList->priority;
+		}
+	}
+	if (pt->basePriority != priority){
+		pt->basePriority = priority;
+		ChangePriority(pt, priority);
+	}
+	if (mutexPt->BlockedList){
+		pt = BlockRemove(&mutexPt->BlockedList);
+		pt->waitMutex = 0;
+		MutexTake(mutexPt, pt);
+		Wake(pt);
+	}
+	else{
+		mutexPt->Owner = 0;
+	}
+}
+
+void OS_MutexUnlock(MutexType *mutexPt){
+	unsigned long held;
+	Enter();
+	if (mutexPt->Owner != RunPt){ // not locked, or locked by another thread
+		mutexPt->BadUnlocks++;
+	}
+	else{
+		held = OS_TimeDifference(mutexPt->LockTime, (uint32_t)HostTime);
+		if (held > mutexPt->MaxHold){
+			mutexPt->MaxHold = held;
+		}
+		MutexRelease(mutexPt);
+	}
+	Leave();
+}
+
+static int FlagsMatch(uint32_t flags, uint32_t mask, uint32_t mode){
+	if (mode & OS_FLAGS_ALL){
+		return (flags & mask) == mask;
+	}
+	return (flags & mask) != 0;
+}
+
+void OS_InitEventFlags(EventFlagsType *eventPt, uint32_t flags){
+	eventPt->Flags = flags;
+	eventPt->BlockedList = 0;
+}
+
+void OS_SetEventFlags(EventFlagsType *eventPt, uint32_t flags){
+	tcbType **link;
+	tcbType *pt;
+	Enter();
+	eventPt->Flags |= flags;
+	link = &eventPt->BlockedList;
+	while (*link){
+		pt = *link;
+		if (FlagsMatch(eventPt->Flags, pt->waitFlags, pt->waitMode)){
+			*link = pt->nextBlocked;
+			pt->waitFlags &= eventPt->Flags;
+			if (pt->waitMode & OS_FLAGS_CLEAR){
+				eventPt->Flags &= ~pt->waitFlags;
+			}
+			Wake(pt);
+		}
+		else{
+			link = &pt->nextBlocked;
+		}
+	}
+	Leave();
+}
+
+void OS_InitMsgQueue(MsgQueueType *queuePt, void *buffer, unsigned long msgSize, unsigned long depth){
+	memset(queuePt, 0, sizeof(*queuePt));
+	queuePt->Buffer = buffer;
+	queuePt->MsgSize = msgSize;
+	queuePt->Depth = depth;
+}
+
+static void MsgPut(MsgQueueType *queuePt, const void *msg){
+	unsigned long i = (queuePt->GetI + queuePt->Count) % queuePt->Depth;
+	memcpy(&queuePt->Buffer[i*queuePt->MsgSize], msg, queuePt->MsgSize);
+	queuePt->Count++;
+	queuePt->Sent++;
+}
+
+int OS_MsgSend(MsgQueueType *queuePt, const void *msg, unsigned long timeout){
+	tcbType *pt;
+	int sent = 1;
+	Enter();
+	if (queuePt->RecvList){
+		pt = WaitWake(&queuePt->RecvList);
+		memcpy(pt->waitMsg, msg, queuePt->MsgSize);
+		queuePt->Sent++;
+	}
+	else if (queuePt->Count < queuePt->Depth){
+		MsgPut(queuePt, msg);
+	}
+	else if ((timeout == OS_NO_WAIT) || InTick || (Critical > 1)){ // periodic tasks cannot wait
+		queuePt->Full++;
+		sent = 0;
+	}
+	else{
+		RunPt->waitMsg = (void *)msg;
+		WaitTimed(&queuePt->SendList, timeout);
+		if (RunPt->timedOut){
+			queuePt->Timeouts++;
+			sent = 0;
+		}
+	}
+	Leave();
+	return sent;
+}
+
+int OS_MsgReceive(MsgQueueType *queuePt, void *msg, unsigned long timeout){
+	tcbType *pt;
+	int got = 1;
+	Enter();
+	if (queuePt->Count){
+		memcpy(msg, &queuePt->Buffer[queuePt->GetI*queuePt->MsgSize], queuePt->MsgSize);
+		queuePt->GetI = (queuePt->GetI + 1) % queuePt->Depth;
+		queuePt->Count--;
+		if (queuePt->SendList){
+			pt = WaitWake(&queuePt->SendList);
+			MsgPut(queuePt, pt->waitMsg);
+		}
+	}
+	else if (timeout == OS_NO_WAIT){
+		got = 0;
+	}
+	else{
+		RunPt->waitMsg = msg;
+		WaitTimed(&queuePt->RecvList, timeout);
+		if (RunPt->timedOut){
+			queuePt->Timeouts++;
+			got = 0;
+		}
+	}
+	Leave();
+	return got;
+}
+
+unsigned long OS_MsgCount(MsgQueueType *queuePt){
+	return queuePt->Count;
+}
+
+void OS_InitPool(MemPoolType *poolPt, void *buffer, unsigned long blockSize, unsigned long blocks){
+	uint8_t *block = (uint8_t *)buffer + blockSize*blocks;
+	unsigned long i;
+	poolPt->FreeList = 0;
+	for (i = 0; i < blocks; i++){
+		block -= blockSize;
+		*(void **)block = poolPt->FreeList;
+		poolPt->FreeList = block;
+	}
+	poolPt->BlockSize = blockSize;
+	poolPt->Blocks = poolPt->Free = poolPt->MinFree = blocks;
+	poolPt->Empty = poolPt->Timeouts = 0;
+	poolPt->WaitList = 0;
+}
+
+void *OS_PoolAlloc(MemPoolType *poolPt, unsigned long timeout){
+	void *block = 0;
+	Enter();
+	if (poolPt->FreeList){
+		block = poolPt->FreeList;
+		poolPt->FreeList = *(void **)block;
+		poolPt->Free--;
+		if (poolPt->Free < poolPt->MinFree){
+			poolPt->MinFree = poolPt->Free;
+		}
+	}
+	else if ((timeout == OS_NO_WAIT) || InTick || (Critical > 1)){ // periodic tasks cannot wait
+		poolPt->Empty++;
+	}
+	else{
+		WaitTimed(&poolPt->WaitList, timeout);
+		if (RunPt->timedOut){
+			poolPt->Timeouts++;
+		}
+		else{
+			block = RunPt->waitMsg;
+		}
+	}
+	Leave();
+	return block;
+}
+
+void OS_PoolFree(MemPoolType *poolPt, void *block){
+	tcbType *pt;
+	Enter();
+	if (poolPt->WaitList){
+		pt = WaitWake(&poolPt->WaitList);
+		pt->waitMsg = block;
+	}
+	else{
+		*(void **)block = poolPt->FreeList;
+		poolPt->FreeList = block;
+		poolPt->Free++;
+	}
+	Leave();
+}
+
+void OS_ClearEventFlags(EventFlagsType *eventPt, uint32_t flags){
+	eventPt->Flags &= ~flags;
+}
+
+uint32_t OS_WaitEventFlags(EventFlagsType *eventPt, uint32_t mask, uint32_t mode){
+	uint32_t result;
+	Enter();
+	if (!FlagsMatch(eventPt->Flags, mask, mode)){
+		RunPt->waitFlags = mask;
+		RunPt->waitMode = mode;
+		BlockInsert(&eventPt->BlockedList, RunPt);
+		Block(BLOCKED); // OS_SetEventFlags fills in waitFlags
+		result = RunPt->waitFlags;
+	}
+	else{
+		result = eventPt->Flags & mask;
+		if (mode & OS_FLAGS_CLEAR){
+			eventPt->Flags &= ~result;
+		}
+	}
+	Leave();
+	return result;
+}
+
+int OS_Notify(unsigned long id, uint32_t bits){
+	tcbType *pt;
+	if (IDINDEX(id) >= NUMTHREADS){
+		return 0;
+	}
+	pt = &tcbs[IDINDEX(id)];
+	Enter();
+	if (pt->available || (pt->id != id)){ // killed, maybe reused by another thread
+		Leave();
+		return 0;
+	}
+	pt->notifyValue |= bits;
+	if ((pt->notifyWait & bits) && (pt->state != READY)){
+		pt->notifyWait = 0;
+		Wake(pt);
+	}
+	Leave();
+	return 1;
+}
+
+uint32_t OS_NotifyWait(uint32_t mask, unsigned long timeout){
+	uint32_t bits;
+	Enter();
+	if (((RunPt->notifyValue & mask) == 0) && (timeout != OS_NO_WAIT)){
+		RunPt->notifyWait = mask;
+		if (timeout == OS_WAIT_FOREVER){
+			Block(BLOCKED);
+		}
+		else{
+			RunPt->wakeTime = HostTime + (uint64_t)timeout*TIME_1MS;
+			Block(SLEEPING); // Tick wakes us if OS_Notify does not
+		}
+		RunPt->notifyWait = 0;
+	}
+	bits = RunPt->notifyValue & mask;
+	RunPt->notifyValue &= ~bits;
+	Leave();
+	return bits;
+}
+
+// Thread pool, same design as os.c
+struct job {
+	void (*func)(void *);
+	void *arg;
+};
+static struct job JobQueue[JOBQUEUESIZE];
+static uint32_t JobPutI, JobGetI;
+static Sema4Type JobsAvailable;
+
+static void PoolWorker(void){
+	struct job job;
+	while(1){
+		OS_Wait(&JobsAvailable);
+		job = JobQueue[JobGetI&(JOBQUEUESIZE-1)];
+		JobGetI++;
+		job.func(job.arg);
+	}
+}
+
+unsigned long OS_InitThreadPool(unsigned long workers, unsigned long stackSize, unsigned long priority){
+	unsigned long i;
+	OS_InitSemaphore(&JobsAvailable, 0);
+	OS_NameSemaphore(&JobsAvailable, "JobsAvailable");
+	JobPutI = JobGetI = 0;
+	for (i = 0; i < workers; i++){
+		if (OS_AddThread(&PoolWorker, stackSize, priority) == 0){
+			break;
+		}
+	}
+	return i;
+}
+
+int OS_SubmitJob(void(*func)(void *), void *arg){
+	if ((JobPutI-JobGetI) & ~(JOBQUEUESIZE-1)){
+		return 0; // full
+	}
+	JobQueue[JobPutI&(JOBQUEUESIZE-1)].func = func;
+	JobQueue[JobPutI&(JOBQUEUESIZE-1)].arg = arg;
+	JobPutI++;
+	OS_Signal(&JobsAvailable);
+	return 1;
+}
+
+int OS_AddTimer(TimerType *timerPt, void(*task)(void), unsigned long delay,
+   unsigned long period, unsigned long priority){
+	uint32_t ticks = (delay + OS_TIMERTICK/2)/OS_TIMERTICK;
+	if (timerPt->Active){
+		return 0;
+	}
+	timerPt->Task = task;
+	timerPt->Period = (period + OS_TIMERTICK/2)/OS_TIMERTICK;
+	if ((period != 0) && (timerPt->Period == 0)){
+		timerPt->Period = 1;
+	}
+	timerPt->Priority = priority;
+	timerPt->Runs = 0;
+	timerPt->Expires = (uint32_t)(HostTime/OS_TIMERTICK) + (ticks ? ticks : 1);
+	timerPt->Active = 1;
+	timerPt->Next = TimerList;
+	if (TimerList){
+		TimerList->Link = &timerPt->Next;
+	}
+	timerPt->Link = &TimerList;
+	TimerList = timerPt;
+	return 1;
+}
+
+void OS_CancelTimer(TimerType *timerPt){
+	if (timerPt->Active){
+		TimerUnlink(timerPt);
+		timerPt->Active = 0;
+	}
+}
+
+int OS_AddPeriodicThread(void(*task)(void), unsigned long period, unsigned long priority){
+	if ((NumPeriodic == NUMPERIODIC) || (period == 0)){
+		return 0;
+	}
+	NumPeriodic++;
+	return OS_AddTimer(&PeriodicTimers[NumPeriodic-1], task, period, period, priority);
+}
+
+int OS_AddSW1Task(void(*task)(void), unsigned long priority){
+	(void)priority;
+	SW1Task = task;
+	return 1;
+}
+
+int OS_AddSW2Task(void(*task)(void), unsigned long priority){
+	(void)priority;
+	SW2Task = task;
+	return 1;
+}
+
+void OS_HostPushSW1(void){
+	if (SW1Task){
+		Critical++;
+		SW1Task();
+		Leave();
+	}
+}
+
+void OS_HostPushSW2(void){
+	if (SW2Task){
+		Critical++;
+		SW2Task();
+		Leave();
+	}
+}
+
+void OS_Sleep(unsigned long sleepTime){
+	if (sleepTime == 0){
+		OS_Suspend();
+		return;
+	}
+	Enter();
+	RunPt->wakeTime = HostTime + (uint64_t)sleepTime*TIME_1MS;
+	Block(SLEEPING);
+	Leave();
+}
+
+void OS_Kill(void){
+	Enter();
+	RunPt->state = BLOCKED;
+	while (RunPt->heldList){ // its waiters would hang
+		MutexRelease(RunPt->heldList);
+	}
+	if (RunPt->period){
+		RtUtilization -= RunPt->utilization;
+		RtThreads--;
+	}
+	DeadPt = RunPt; // freed once Switch() has left its stack
+	Switch();       // never returns
+}
+
+void OS_Suspend(void){
+	Enter();
+	RunPt->yielded = 1;
+	Switch();
+	Leave();
+}
+
+unsigned long OS_Time(void){
+	unsigned long time;
+	Enter();
+	time = (unsigned long)(uint32_t)HostTime;
+	Leave();
+	return time;
+}
+
+unsigned long OS_TimeDifference(unsigned long start, unsigned long stop){
+	return (uint32_t)(stop-start);
+}
+
+uint64_t OS_Time64(void){
+	uint64_t time;
+	Enter();
+	time = HostTime;
+	Leave();
+	return time;
+}
+
+int OS_Debounce(DebounceType *debouncePt, unsigned long holdoff){
+	int accept;
+	Enter();
+	accept = (debouncePt->Accepted == 0) || (HostTime - debouncePt->Last >= holdoff);
+	if (accept){
+		debouncePt->Last = HostTime;
+		debouncePt->Accepted++;
+	}
+	else{
+		debouncePt->Rejected++;
+	}
+	Leave();
+	return accept;
+}
+
+void OS_ClearMsTime(void){
+	MsBase = HostTime;
+}
+
+unsigned long OS_MsTime(void){
+	unsigned long time;
+	Enter();
+	time = (unsigned long)((HostTime - MsBase)/TIME_1MS);
+	Leave();
+	return time;
+}
+
+unsigned long OS_CpuLoad(unsigned long window){
+	uint32_t n, i;
+	uint64_t idle = 0;
+	n = (window + CPULOADSLOTMS - 1)/CPULOADSLOTMS;
+	if (n > CPULOADSLOTS){
+		n = CPULOADSLOTS;
+	}
+	if (n > IdleSlots){
+		n = IdleSlots;
+	}
+	if (n == 0){
+		return 0;
+	}
+	for (i = 1; i <= n; i++){
+		idle += IdleHistory[(IdleSlots - i)%CPULOADSLOTS];
+	}
+	return 1000 - (unsigned long)(idle*1000/((uint64_t)n*CPULOADSLOTMS*TIME_1MS));
+}
+
+void OS_HostRunFor(unsigned long ms){
+	HostStopTime = HostTime + (uint64_t)ms*TIME_1MS;
+}
+
+// ******** OS_Launch ************
+// run the threads until HostStopTime, or until nothing is left to run
+// unlike the target this returns
+void OS_Launch(unsigned long theTimeSlice){
+	struct sigaction sa;
+	struct itimerval spin;
+	TimeSlice = theTimeSlice;
+	sa.sa_handler = SpinCheck;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGVTALRM, &sa, 0);
+	spin.it_interval.tv_sec = 0;
+	spin.it_interval.tv_usec = SPINPERIOD;
+	spin.it_value = spin.it_interval;
+	setitimer(ITIMER_VIRTUAL, &spin, 0);
+	NextSlot = HostTime + CPULOADSLOTMS*TIME_1MS;
+	Launched = 1;
+	IntMasked = 0;
+	Critical = 1;
+	RunPt = Pick();
+	if (RunPt){
+		RunPt->ExecCount++;
+		SliceStart = HostTime;
+		swapcontext(&HostMainCtx, &RunPt->ctx);
+	}
+	spin.it_value.tv_usec = 0;
+	spin.it_interval.tv_usec = 0;
+	setitimer(ITIMER_VIRTUAL, &spin, 0);
+	Launched = 0;
+	Critical = 0;
+	IntMasked = 1;
+}
+
+void OS_InitBuzzer(void){
+}
+
+void delay(int count){
+	uint64_t end = HostTime + (uint64_t)count*DELAYCOST;
+	Critical++;
+	while (HostTime < end){ // the target busy-waits, timers keep running
+		HostTime = NextEvent();
+		if (HostTime > end){
+			HostTime = end;
+		}
+		Tick();
+	}
+	Leave();
+}
+
+void OS_CreateSound(int frequency, int tempo){
+	(void)frequency;
+	delay(tempo);
+}
+
+void OS_StopSound(void){
+}
+
+void OS_Music(int notes[9], int tempo[9]){
+	int i;
+	for (i = 0; i < 9; i++){
+		OS_CreateSound(notes[i], tempo[i]);
+	}
+}
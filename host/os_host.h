@@ -0,0 +1,33 @@
+// filename **********os_host.h***********
+// Extra controls of the Linux port of os.h, see os_host.c
+// Target code never includes this file.
+
+#ifndef _OS_HOST_H_
+#define _OS_HOST_H_
+#include <stdint.h>
+
+extern uint64_t HostTime;       // simulated time in 12.5ns units since OS_Init
+extern uint64_t HostStopTime;   // OS_Launch returns once HostTime reaches this
+extern uint64_t HostSwitches;   // context switches performed
+extern uint64_t HostSkips;      // times the clock jumped because every ready thread was polling
+extern uint32_t HostShuffle;    // nonzero: pick a random ready thread among equals, for fuzzing
+
+// ******** OS_HostRunFor ************
+// make the next OS_Launch return after some simulated time
+// input:  run length in ms
+// output: none
+void OS_HostRunFor(unsigned long ms);
+
+// ******** OS_HostPushSW1 ************
+// run the task given to OS_AddSW1Task as if button 1 was pushed
+// input:  none
+// output: none
+void OS_HostPushSW1(void);
+
+// ******** OS_HostPushSW2 ************
+// run the task given to OS_AddSW2Task as if button 2 was pushed
+// input:  none
+// output: none
+void OS_HostPushSW2(void);
+
+#endif
@@ -1,6 +1,7 @@
 #include <stdint.h>
 #include "joystick.h"
 #include "tm4c123gh6pm.h"
+#include "critical.h"
 
 void DisableInterrupts(void); // Disable interrupts
 void EnableInterrupts(void);  // Enable interrupts
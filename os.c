@@ -23,12 +23,14 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 #include "os.h"
 #include "PLL.h"
 #include "tm4c123gh6pm.h"
 #include "LCD.h"
 #include "UART.h"
 #include "joystick.h"
+#include "trace.h"
 
 // Functions implemented in assembly files
 void OS_DisableInterrupts(void);	// Disable interrupts
@@ -47,41 +49,707 @@ void (*ButtonOneTask)(void);
 void (*ButtonTwoTask)(void);
 
 #define NUMTHREADS	20					// Maximum number of threads
-#define STACKSIZE		100      		// Number of 32-bit words in stack
+#define IDINDEX(id)	((id) & 0xFF)		// tcbs index of a thread ID, the bits above count reuses of the TCB
+#define STACKSIZE	400					// Bytes of the usual thread stack, the game threads ask for this
+#define STACKARENASIZE	(NUMTHREADS*(STACKSIZE+8+STACKREDZONE))	// Bytes shared by all thread stacks, NUMTHREADS of STACKSIZE with their headers
+#define MINSTACKSIZE	128					// Smallest stack in bytes, room for the initial frame and interrupts
+#define IDLESTACKSIZE	256					// Bytes of the idle thread stack, every interrupt that wakes it from WFI stacks on it
 
 // Macros
 #define blockSema								// Blocking sempahores
 #define prioritySched						// Fixed priority scheduler
 #define aging										// Dynamic priority scheculer with aging
+#define readyQueue							// O(1) per-priority ready lists found with a bitmap
+#define sleepQueue							// Sleeping threads kept in a delta-sorted queue
+//#define tickless							// Timer2A runs one-shot until the next wakeup (needs sleepQueue, aging only with readyQueue)
+//#define schedulerProfile			// Record Scheduler() execution time per thread count, SCHEDBENCH in Main.c drives it
+#define tickProfile							// Record Timer2A_Handler() execution time
+#define stackCheck							// Paint stacks and check a guard word on every switch
+//#define stackHalt							// Stop everything at a broken guard word instead of only the thread (needs stackCheck)
+#define threadStats							// Charge CPU time to each thread and to interrupts
+#define kernelTrace							// Log switches, semaphores, thread and periodic task events to trace.c
+#define timerWheel							// Periodic and one-shot tasks share Timer1A through a timer wheel
+//#define edfSched							// Threads from OS_AddDeadlineThread run earliest deadline first (needs readyQueue)
+//#define rmSched								// Threads from OS_AddDeadlineThread run shortest period first (needs readyQueue)
+// semaStats is set in os.h, it changes Sema4Type and MutexType
+#define idleThread							// OS_Launch adds a lowest priority thread that sleeps with WFI, OS_CpuLoad measures it
+
+#define NUMPRIORITIES	8					// Priorities 0 (highest) to 7 (lowest)
+#define IDLEPRIORITY	(NUMPRIORITIES-1)	// With idleThread only the idle thread runs at this level
+#define CPULOADSLOTMS	100					// OS_CpuLoad keeps idle time in slots of this many ms
+#define CPULOADSLOTS	50					// Slots kept, the longest OS_CpuLoad window
+#define RTUTILMAX	1000000				// EDF admission limit on the sum of Wcet/Period, parts per million
+#define NUMPERIODIC	8						// Timers kept for OS_AddPeriodicThread
+#define WHEELBITS	6							// Each wheel level has 2^WHEELBITS slots
+#define WHEELLEVELS	3						// 100us, 6.4ms and 410ms slots, 26s span before re-cascading
+
+#if defined(readyQueue) && !(defined(blockSema) && defined(prioritySched) && defined(aging))
+#error "readyQueue requires blockSema, prioritySched and aging"
+#endif
+#if defined(edfSched) || defined(rmSched)
+#define deadlineSched						// Priority 0 is kept for deadline threads, sorted instead of round robin
+#if !defined(readyQueue) || (defined(edfSched) && defined(rmSched))
+#error "edfSched or rmSched needs readyQueue, and only one of them can be chosen"
+#endif
+#endif
+#ifdef deadlineSched
+#define AGEFLOOR	1							// aging never lifts a thread into the deadline level
+#else
+#define AGEFLOOR	0
+#endif
+#ifdef idleThread
+#define AGES(pt)	(((pt)->WorkPriority > AGEFLOOR) && ((pt) != IdlePt)) // the idle thread never competes
+#else
+#define AGES(pt)	((pt)->WorkPriority > AGEFLOOR)
+#endif
+#if defined(aging) && defined(readyQueue)
+#define lazyAging								// Ready threads are aged by Scheduler() from ReadySince, not every 1 ms
+#endif
+#if defined(tickless) && (!defined(sleepQueue) || (defined(aging) && !defined(lazyAging)))
+#error "tickless requires sleepQueue, and aging only works with it through readyQueue"
+#endif
 
 // TCB Data Structure
 struct tcb {
   int32_t *sp;           // Pointer to stack (valid for threads not running
-  struct tcb *next;      // Linked list pointer
-  uint32_t id;           // Thread #
+  struct tcb *next;      // Next thread in the ring of live threads, next free TCB when unused
+  struct tcb *prev;      // Previous thread in the ring
+  int32_t *stackBase;    // Lowest address of the stack carved from StackArena
+  uint32_t stackSize;    // Size of the stack in bytes, multiple of 8
+  uint32_t id;           // Thread ID, tcbs index plus 256 times the number of threads this TCB has held
   uint32_t available;    // Used to indicate if this tcb is available or not
-	uint32_t sleepCt;	     // Sleep counter in MS
+	uint32_t sleepCt;	     // Sleep counter in MS (with sleepQueue: requested time, nonzero while asleep)
   uint32_t ArriveTime;   // First time thread is added to the system
   uint32_t WaitTime;     // Elapsed time since thread arrived till it starts execution
   uint32_t ExecCount;    // Number of times thread is executed (switched to)
+  void (*task)(void);    // Entry point, identifies the thread
+#ifdef threadStats
+  uint64_t RunTime;      // 12.5ns units spent running this thread, interrupts excluded
+  uint64_t IsrTime;      // 12.5ns units of interrupts that ran on top of this thread
+#endif
+#ifdef deadlineSched
+  uint32_t Period;       // ms between releases, 0 for a thread without a deadline
+  uint32_t Wcet;         // CPU budget per job in 12.5ns units
+  uint32_t Utilization;  // Wcet/Period in parts per million
+  uint32_t Release;      // KernelNow() the current job was released
+  uint32_t Deadline;     // KernelNow() the current job must finish by
+  uint32_t Jobs;         // jobs finished with OS_WaitPeriod
+  uint32_t DeadlineMisses; // jobs finished late or skipped because they were already late
+#ifdef threadStats
+  uint64_t JobStart;     // RunTime when the current job was released
+  uint32_t BudgetOverruns; // jobs that used more than Wcet
+#endif
+#endif
 #ifdef blockSema
   Sema4Type *blockPt;    // Pointer to resource thread is blocked on (0 if not)
+  struct tcb *nextBlocked; // Next thread blocked on the same semaphore or mutex
 #endif
+#ifdef readyQueue
+  MutexType *waitMutex;  // Mutex thread is blocked on (0 if not)
+  MutexType *heldList;   // Mutexes this thread owns, linked through NextHeld
+  EventFlagsType *waitEvents; // Event flag group thread is blocked on (0 if not)
+  uint32_t waitFlags;    // Flags waited for, then the flags that woke the thread
+  uint32_t waitMode;     // OS_FLAGS_ANY or OS_FLAGS_ALL, plus OS_FLAGS_CLEAR
+  struct tcb **waitList; // List of a message queue or timed semaphore wait (0 if not)
+  void *waitMsg;         // Message to send, place for the message to receive, or block from OS_PoolFree
+  uint32_t timedOut;     // 1 if the sleep queue ended the last timed wait
+  uint32_t notifyWait;   // Mask given to OS_NotifyWait while blocked in it (0 if not)
+#endif
+  uint32_t notifyValue;  // Bits from OS_Notify not yet taken by OS_NotifyWait
 #ifdef prioritySched
 #ifdef aging
-  uint32_t age;          // How long the thread has been active
+  uint32_t age;          // How long the thread has been active (with lazyAging: up to ReadySince)
   uint32_t FixedPriority;// Permanent priority
+  uint32_t BasePriority; // FixedPriority, or higher while inheriting it through a mutex
   uint32_t WorkPriority; // Temporary priority 
 #else
 	uint32_t priority;
 #endif
 #endif
+#ifdef lazyAging
+  uint32_t ReadySince;   // KernelNow() when age was last brought up to date
+#endif
+#ifdef readyQueue
+  struct tcb *nextReady; // Next thread in the ready list of the same priority
+  struct tcb *prevReady; // Previous thread in the ready list of the same priority
+  uint32_t ready;        // 1 if the thread is linked into a ready list
+#endif
+#ifdef sleepQueue
+  struct tcb *nextSleep; // Next thread in the sleep queue
+  uint32_t sleepDelta;   // ms to wake after the previous thread in the sleep queue
+#endif
+#ifdef semaStats
+  uint32_t lockWaitStart; // OS_Time() when it began waiting on a semaphore or mutex
+#endif
 };
 typedef struct tcb tcbType;
 
 tcbType *RunPt;														// Pointer to the currently running TCB
 tcbType tcbs[NUMTHREADS]; 								// Statically allocated memory for TCBs
-int32_t Stacks[NUMTHREADS][STACKSIZE];		// Statically allocated memory for Stacks
+tcbType *ThreadRing;											// Any live thread, new threads are linked in just before it
+tcbType *FreeTcbs;												// Unused TCBs linked through next
+tcbType *DeadPt;													// Killed thread, its TCB and stack are freed once it is switched out
+
+#ifdef kernelTrace
+#define TRACE(type,id,arg)	Trace_Record(type, id, arg)
+// events raised inside an interrupt handler belong to no thread
+#define TRACEID	((NVIC_INT_CTRL_R & NVIC_INT_CTRL_VEC_ACT_M) ? TRACE_ISR : RunPt->id)
+#define TRACEADDR(pt)	((uint16_t)(uint32_t)(pt)) // SRAM is 32K so the low half is unique
+#define TRACESEMA(semaPt)	TRACEADDR(semaPt)
+#else
+#define TRACE(type,id,arg)
+#endif
+
+// Stack arena ------------------------------------------------------------------------
+// Thread stacks are carved from one arena with a first-fit allocator. Every
+// block starts with an 8-byte header, so stacks stay double word aligned.
+// Free blocks are kept in address order and merged with their neighbours.
+struct stackBlock {
+	uint32_t size;             // Bytes in this block, including the header
+	struct stackBlock *next;   // Next free block by address (free blocks only)
+};
+typedef struct stackBlock stackBlockType;
+
+#ifdef stackCheck
+// Unused stack is painted with STACKPAINT when a thread is created and the
+// lowest word holds STACKGUARD. Scheduler() checks the guard of the thread it
+// switches away from, and OS_StackUsage() finds the deepest word overwritten.
+// STACKREDZONE painted bytes sit between the block header and the guard, so
+// an overflow that is caught at the next switch has not reached the header.
+// A thread with a broken guard is stopped and its stack is never reused.
+#define STACKPAINT	0xCDCDCDCD
+#define STACKGUARD	0xDEADBEEF
+#define STACKREDZONE	32						// Bytes below the guard word, multiple of 8
+unsigned long StackOverflows;					// Number of threads stopped for a broken guard word
+uint32_t StackOverflowId;							// Thread ID of the last overflow
+#else
+#define STACKREDZONE	0
+#endif
+
+uint64_t StackArena[STACKARENASIZE/8];	// 64-bit elements for 8-byte alignment
+stackBlockType *StackFreeList;				// Free blocks in address order
+
+// ******** StackInit ************
+// make the whole arena one free block
+static void StackInit(void){
+	StackFreeList = (stackBlockType *)StackArena;
+	StackFreeList->size = sizeof(StackArena);
+	StackFreeList->next = 0;
+}
+
+// ******** StackAlloc ************
+// carve a stack out of the arena
+// input:  stack size in bytes, multiple of 8
+// output: lowest address of the stack, 0 if there is no room
+// call with interrupts disabled
+static int32_t *StackAlloc(uint32_t size){
+	stackBlockType **link = &StackFreeList;
+	stackBlockType *block, *rest;
+	size += sizeof(stackBlockType);
+	while ((*link) && ((*link)->size < size)){
+		link = &((*link)->next);
+	}
+	block = *link;
+	if (block == 0){
+		return 0;
+	}
+	if (block->size - size >= sizeof(stackBlockType) + MINSTACKSIZE){ // split, keep the tail free
+		rest = (stackBlockType *)((uint8_t *)block + size);
+		rest->size = block->size - size;
+		rest->next = block->next;
+		block->size = size;
+		*link = rest;
+	}
+	else{
+		*link = block->next;
+	}
+	return (int32_t *)(block + 1);
+}
+
+// ******** StackFree ************
+// give a stack back to the arena, merging it with free neighbours
+// input:  address returned by StackAlloc
+// call with interrupts disabled
+static void StackFree(int32_t *stack){
+	stackBlockType *block = (stackBlockType *)stack - 1;
+	stackBlockType *prev = 0;
+	stackBlockType *next = StackFreeList;
+	while (next && (next < block)){
+		prev = next;
+		next = next->next;
+	}
+	if (next && ((uint8_t *)block + block->size == (uint8_t *)next)){ // merge with the following block
+		block->size += next->size;
+		next = next->next;
+	}
+	block->next = next;
+	if (prev && ((uint8_t *)prev + prev->size == (uint8_t *)block)){ // merge with the preceding block
+		prev->size += block->size;
+		prev->next = block->next;
+	}
+	else if (prev){
+		prev->next = block;
+	}
+	else{
+		StackFreeList = block;
+	}
+}
+
+#ifdef idleThread
+tcbType *IdlePt;			// the thread OS_Launch added, 0 before
+#endif
+
+// ms since OS_Init for the kernel's own timing, OS_ClearMsTime leaves it alone
+static uint32_t KernelMs;
+#ifdef tickless
+static uint32_t TickElapsed(void);
+#endif
+
+// ******** KernelNow ************
+// KernelMs including the part of a tickless interval that has passed
+// call with interrupts disabled
+static uint32_t KernelNow(void){
+#ifdef tickless
+	return KernelMs + TickElapsed()/TIME_1MS;
+#else
+	return KernelMs;
+#endif
+}
+
+#ifdef readyQueue
+// One circular list per priority holds every thread that can run (including RunPt).
+// Bit (31-p) of ReadyBitmap is set when ReadyList[p] is not empty, so the
+// highest ready priority is the count of leading zeros of the bitmap.
+tcbType *ReadyList[NUMPRIORITIES];
+uint32_t ReadyBitmap;
+
+#ifdef deadlineSched
+// ******** RunsBefore ************
+// order of threads at priority 0: threads without a deadline (there through
+// a mutex) first, then earliest deadline (edfSched) or shortest period (rmSched)
+// call with interrupts disabled
+static int RunsBefore(tcbType *a, tcbType *b){
+	if (b->Period == 0){
+		return 0;
+	}
+	if (a->Period == 0){
+		return 1;
+	}
+#ifdef edfSched
+	return (int32_t)(a->Deadline - b->Deadline) < 0;
+#else
+	return a->Period < b->Period;
+#endif
+}
+
+#endif
+#ifdef lazyAging
+// A ready thread gains one priority level for every 9 ms it stays ready, as
+// if its age were counted every 1 ms. Instead of counting, each thread keeps
+// the time it was last brought up to date. ReadyRemove() catches a thread up
+// when it leaves the ready lists, and Scheduler() catches up every ready
+// thread once NextAgeTime, the earliest pending boost, has come.
+uint32_t NextAgeTime;
+uint32_t AgePasses;			// times Scheduler() went over the ready threads
+
+// ******** AgeCount ************
+// add the ms a ready thread has waited since ReadySince to its age, and
+// raise its working priority one level every time the age passes 8
+// input:  thread, KernelNow()
+// output: number of levels gained
+// call with interrupts disabled, does not move the thread between lists
+static uint32_t AgeCount(tcbType *pt, uint32_t now){
+	uint32_t credit = now - pt->ReadySince;
+	uint32_t need = (pt->age < 9) ? 9 - pt->age : 1; // ms to the next level
+	uint32_t levels = 0;
+	pt->ReadySince = now;
+	while ((credit >= need) && AGES(pt)){
+		credit -= need;
+		pt->age = 0;
+		pt->WorkPriority--;
+		levels++;
+		need = 9;
+	}
+	pt->age += credit;
+	return levels;
+}
+
+// ******** AgeDue ************
+// KernelNow() at which a ready thread gains its next level
+static uint32_t AgeDue(tcbType *pt){
+	return pt->ReadySince + ((pt->age < 9) ? 9 - pt->age : 1);
+}
+
+#endif
+// ******** ReadyInsert ************
+// link a thread at the tail of the ready list of its working priority
+// call with interrupts disabled
+static void ReadyInsert(tcbType *pt){
+	uint32_t p = pt->WorkPriority;
+	tcbType *head = ReadyList[p];
+#ifdef lazyAging
+	pt->ReadySince = KernelNow(); // its age counts from now
+	if (AGES(pt) && ((int32_t)(AgeDue(pt) - NextAgeTime) < 0)){
+		NextAgeTime = AgeDue(pt);
+	}
+#endif
+	if (head == 0){
+		pt->nextReady = pt;
+		pt->prevReady = pt;
+		ReadyList[p] = pt;
+		ReadyBitmap |= 0x80000000 >> p;
+	}
+#ifdef deadlineSched
+	else if (p == 0){ // sorted, the head runs first
+		while (!RunsBefore(pt, head)){
+			head = head->nextReady;
+			if (head == ReadyList[0]){
+				break; // goes last
+			}
+		}
+		pt->nextReady = head;
+		pt->prevReady = head->prevReady;
+		head->prevReady->nextReady = pt;
+		head->prevReady = pt;
+		if (RunsBefore(pt, ReadyList[0])){
+			ReadyList[0] = pt;
+		}
+	}
+#endif
+	else{ // tail is just before the head
+		pt->nextReady = head;
+		pt->prevReady = head->prevReady;
+		head->prevReady->nextReady = pt;
+		head->prevReady = pt;
+	}
+	pt->ready = 1;
+}
+
+// ******** ReadyRemove ************
+// unlink a thread from the ready list of its working priority
+// call with interrupts disabled
+static void ReadyRemove(tcbType *pt){
+	uint32_t p = pt->WorkPriority;
+	if (pt->ready == 0){ // already blocked, sleeping or killed, its links are stale
+		return;
+	}
+	if (pt->nextReady == pt){ // last one at this priority
+		ReadyList[p] = 0;
+		ReadyBitmap &= ~(0x80000000 >> p);
+	}
+	else{
+		pt->prevReady->nextReady = pt->nextReady;
+		pt->nextReady->prevReady = pt->prevReady;
+		if (ReadyList[p] == pt){
+			ReadyList[p] = pt->nextReady;
+		}
+	}
+	pt->ready = 0;
+#ifdef lazyAging
+	AgeCount(pt, KernelNow()); // levels gained while ready stay until it is next chosen
+#endif
+}
+
+#ifdef lazyAging
+// ******** AgePass ************
+// bring every ready thread up to date and move those that gained levels
+// still a loop over all NUMTHREADS TCBs, so the switch that finds
+// NextAgeTime has come costs O(NUMTHREADS) in PendSV; the others do not
+// call with interrupts disabled
+static void AgePass(uint32_t now){
+	int i;
+	tcbType *pt;
+	uint32_t due;
+	NextAgeTime = now + 0x7FFFFFFF; // nothing due unless a ready thread can still rise
+	AgePasses++;
+	for (i = 0; i < NUMTHREADS; i++){
+		pt = &tcbs[i];
+		if (pt->ready && AGES(pt)){
+			if ((int32_t)(now - AgeDue(pt)) >= 0){
+				ReadyRemove(pt); // counts its levels
+				ReadyInsert(pt); // at the new priority, its age is up to date
+			}
+			if (AGES(pt)){
+				due = AgeDue(pt);
+				if ((int32_t)(due - NextAgeTime) < 0){
+					NextAgeTime = due;
+				}
+			}
+		}
+	}
+}
+#endif
+
+// ******** ReadyWake ************
+// make a blocked or sleeping thread ready, and switch to it as soon as the
+// current interrupt returns if it outranks the running thread
+// call with interrupts disabled
+static void ReadyWake(tcbType *pt){
+	ReadyInsert(pt);
+	if (pt->WorkPriority < RunPt->WorkPriority){
+		NVIC_INT_CTRL_R = NVIC_INT_CTRL_PEND_SV;
+	}
+#ifdef deadlineSched
+	else if ((pt->WorkPriority == 0) && (RunPt->WorkPriority == 0) && RunsBefore(pt, RunPt)){
+		NVIC_INT_CTRL_R = NVIC_INT_CTRL_PEND_SV; // earlier deadline preempts
+	}
+#endif
+}
+#endif
+
+#ifdef sleepQueue
+static void SleepRemove(tcbType *pt);
+#endif
+
+#ifdef blockSema
+// ******** WaitInsert ************
+// link a thread into a wait list behind every thread of equal or higher priority
+// call with interrupts disabled
+static void WaitInsert(tcbType **link, tcbType *pt){
+#ifdef prioritySched
+#ifdef aging
+	while ((*link) && ((*link)->WorkPriority <= pt->WorkPriority)){
+#else
+	while ((*link) && ((*link)->priority <= pt->priority)){
+#endif
+		link = &((*link)->nextBlocked);
+	}
+#else
+	while (*link){
+		link = &((*link)->nextBlocked);
+	}
+#endif
+	pt->nextBlocked = *link;
+	*link = pt;
+}
+
+// ******** WaitRemove ************
+// unlink a given thread from a wait list
+// call with interrupts disabled
+static void WaitRemove(tcbType **link, tcbType *pt){
+	while ((*link) && (*link != pt)){
+		link = &((*link)->nextBlocked);
+	}
+	if (*link){
+		*link = pt->nextBlocked;
+	}
+}
+
+// ******** BlockInsert ************
+// queue a thread on a semaphore behind every waiter of equal or higher priority
+// call with interrupts disabled
+static void BlockInsert(Sema4Type *semaPt, tcbType *pt){
+	WaitInsert(&semaPt->BlockedList, pt);
+	pt->blockPt = semaPt;
+}
+
+// ******** BlockRemove ************
+// take the first waiter off a semaphore, list must not be empty
+// call with interrupts disabled
+static tcbType *BlockRemove(Sema4Type *semaPt){
+	tcbType *pt = semaPt->BlockedList;
+	semaPt->BlockedList = pt->nextBlocked;
+	pt->blockPt = 0;
+#if defined(readyQueue) && defined(sleepQueue)
+	pt->waitList = 0;
+	if (pt->sleepCt){ // OS_WaitTimeout, it no longer needs waking by the sleep queue
+		SleepRemove(pt);
+	}
+#endif
+	return pt;
+}
+#endif
+
+#ifdef sleepQueue
+// Sleeping threads in wake-up order. Each sleepDelta is relative to the thread
+// before it, so the timer interrupt only has to look at the head.
+tcbType *SleepList;
+
+// ******** SleepInsert ************
+// queue a thread that wakes up sleepTime ms from now
+// call with interrupts disabled
+static void SleepInsert(tcbType *pt, uint32_t sleepTime){
+	tcbType **link = &SleepList;
+	while ((*link) && ((*link)->sleepDelta <= sleepTime)){
+		sleepTime -= (*link)->sleepDelta;
+		link = &((*link)->nextSleep);
+	}
+	if (*link){
+		(*link)->sleepDelta -= sleepTime; // later threads keep their wake time
+	}
+	pt->sleepDelta = sleepTime;
+	pt->nextSleep = *link;
+	*link = pt;
+}
+
+// ******** SleepAdvance ************
+// account for elapsed ms and wake up every thread that is due
+// call with interrupts disabled
+static void SleepAdvance(uint32_t elapsed){
+	tcbType *pt;
+	while (SleepList && (SleepList->sleepDelta <= elapsed)){
+		pt = SleepList;
+		elapsed -= pt->sleepDelta;
+		SleepList = pt->nextSleep;
+		pt->sleepCt = 0;
+#ifdef readyQueue
+		if (pt->waitList){ // a timed wait ran out
+			WaitRemove(pt->waitList, pt);
+			pt->waitList = 0;
+			pt->timedOut = 1;
+			if (pt->blockPt){ // give back the count it took from the semaphore
+				pt->blockPt->Value++;
+				pt->blockPt->Timeouts++;
+				pt->blockPt = 0;
+			}
+		}
+		ReadyWake(pt);
+#endif
+	}
+	if (SleepList){
+		SleepList->sleepDelta -= elapsed;
+	}
+}
+
+// ******** SleepRemove ************
+// take a thread out of the sleep queue before it is due
+// call with interrupts disabled
+static void SleepRemove(tcbType *pt){
+	tcbType **link = &SleepList;
+	while ((*link) && (*link != pt)){
+		link = &((*link)->nextSleep);
+	}
+	if (*link){
+		*link = pt->nextSleep;
+		if (pt->nextSleep){
+			pt->nextSleep->sleepDelta += pt->sleepDelta; // later threads keep their wake time
+		}
+	}
+	pt->sleepCt = 0;
+}
+#endif
+
+#if defined(readyQueue) && defined(sleepQueue)
+// ******** WaitTimed ************
+// block RunPt on a wait list, and in the sleep queue unless timeout is OS_WAIT_FOREVER
+// call with interrupts disabled, then enable them and OS_Suspend()
+static void WaitTimed(tcbType **list, uint32_t timeout){
+	WaitInsert(list, RunPt);
+	RunPt->waitList = list;
+	RunPt->timedOut = 0;
+	ReadyRemove(RunPt);
+	if (timeout != OS_WAIT_FOREVER){
+		RunPt->sleepCt = timeout;
+		SleepInsert(RunPt, timeout);
+	}
+}
+
+// ******** WaitWake ************
+// take the first thread off a message queue or pool wait list, list must not be empty
+// call with interrupts disabled
+static tcbType *WaitWake(tcbType **list){
+	tcbType *pt = *list;
+	*list = pt->nextBlocked;
+	pt->waitList = 0;
+	if (pt->sleepCt){
+		SleepRemove(pt);
+	}
+	ReadyWake(pt);
+	return pt;
+}
+#endif
+
+#ifdef tickless
+static void TickCatchUp(void);
+static void TickRestart(void);
+#endif
+
+#ifdef tickProfile
+// Timer2A_Handler() execution time in 12.5ns units
+unsigned long TickMaxTime;
+unsigned long TickTotalTime;
+unsigned long TickCount;
+#endif
+
+#ifdef threadStats
+// Every switch charges the time since the previous one to the outgoing thread.
+// Interrupts bracket themselves with OS_IsrEnter/OS_IsrExit, and the
+// interrupt time that passed while a thread ran is charged separately.
+uint32_t SwitchTime;				// OS_Time() when RunPt was switched in
+uint64_t IsrTotal;					// 12.5ns units spent in interrupts, nested ones counted once
+uint64_t IsrAtSwitch;				// IsrTotal when RunPt was switched in
+uint32_t IsrStart;					// OS_Time() when the outermost interrupt started
+uint32_t IsrNest;						// Depth of interrupts that called OS_IsrEnter
+
+// ******** ChargeRunPt ************
+// add the time since the last switch to RunPt
+// call with interrupts disabled
+static void ChargeRunPt(void){
+	uint32_t now = OS_Time();
+	uint32_t elapsed = OS_TimeDifference(SwitchTime, now);
+	uint32_t isr = (uint32_t)(IsrTotal - IsrAtSwitch);
+	if (isr > elapsed){
+		isr = elapsed;
+	}
+	RunPt->RunTime += elapsed - isr;
+	RunPt->IsrTime += isr;
+	SwitchTime = now;
+	IsrAtSwitch = IsrTotal;
+}
+#endif
+
+#ifdef schedulerProfile
+// Scheduler() execution time in 12.5ns units, indexed by the number of live threads
+unsigned long SchedMaxTime[NUMTHREADS+1];
+unsigned long SchedTotalTime[NUMTHREADS+1];
+unsigned long SchedCount[NUMTHREADS+1];
+unsigned long SliceCount;	// switches caused by SysTick, the rest are yields and wakeups
+#endif
+
+#ifdef idleThread
+// The idle thread is the only one at IDLEPRIORITY and never blocks, so
+// Scheduler() always has a thread to run. Scheduler() adds the time the idle
+// thread held the CPU to IdleSlot, and every CPULOADSLOTMS the slot moves
+// into IdleHistory, from which OS_CpuLoad sums any window it is asked for.
+// An idle run that crosses slot boundaries is split at each one.
+uint32_t IdleStart;								// OS_Time() when the idle thread got the CPU
+uint32_t IdleSlot;								// 12.5ns units idle in the current slot
+uint32_t IdleHistory[CPULOADSLOTS];	// idle time of the last slots, IdleSlots%CPULOADSLOTS is the oldest
+uint32_t IdleSlots;								// slots finished since OS_Launch
+static uint32_t SlotEnd;					// OS_Time() when the current slot ends
+static int AddThread(void(*task)(void), unsigned long stackSize, unsigned long priority,
+	uint32_t period, uint32_t wcet, uint32_t utilization);
+
+// ******** IdleTask ************
+// sleep until the next interrupt, PendSV then switches if it woke a thread
+static void IdleTask(void){
+	while(1){
+		WaitForInterrupt();
+	}
+}
+
+// ******** IdleCharge ************
+// add the time the idle thread has run to IdleSlot and close the slots
+// that have passed
+// call with interrupts disabled
+static void IdleCharge(void){
+	uint32_t now = OS_Time();
+	while ((int32_t)(now - SlotEnd) >= 0){
+		if ((RunPt == IdlePt) && ((int32_t)(SlotEnd - IdleStart) > 0)){ // idle across the boundary
+			IdleSlot += OS_TimeDifference(IdleStart, SlotEnd);
+			IdleStart = SlotEnd; // the rest goes to the next slot
+		}
+		IdleHistory[IdleSlots%CPULOADSLOTS] = IdleSlot;
+		IdleSlots++;
+		IdleSlot = 0;
+		SlotEnd += CPULOADSLOTMS*TIME_1MS;
+	}
+	if ((RunPt == IdlePt) && ((int32_t)(now - IdleStart) > 0)){
+		IdleSlot += OS_TimeDifference(IdleStart, now);
+		IdleStart = now;
+	}
+}
+#endif
 
 // ******** OS_Init ************
 // initialize operating system, disable interrupts until OS_Launch
@@ -93,34 +761,56 @@ void OS_Init(void){int i;
   PLL_Init(Bus80MHz);                 // set processor clock to 80 MHz
 	for(i = 0; i < NUMTHREADS; i++){
 		tcbs[i].available = 1; // initial available
+		tcbs[i].next = (i < NUMTHREADS-1) ? &tcbs[i+1] : 0;
 	}  
-	InitTimer2A(TIME_1MS);  // initialize Timer2A which is used for software timer and decrease the sleepCt
+	FreeTcbs = &tcbs[0]; // handed out in index order until threads are killed
+	ThreadRing = 0;
+	RunPt = 0;
+	DeadPt = 0;
+	StackInit();
+#ifdef kernelTrace
+	Trace_Init();
+#endif
+	InitTimer2A(TIME_1MS);  // initialize Timer2A which is used for software timer and wakes sleeping threads
 	InitTimer3A();
   OS_ClearMsTime();
   
   NVIC_ST_CTRL_R = 0;         // disable SysTick during setup
   NVIC_ST_CURRENT_R = 0;      // any write to current clears it
-															// lowest PRI so only foreground interrupted
-  NVIC_SYS_PRI3_R =(NVIC_SYS_PRI3_R&0x00FFFFFF)|0xE0000000; // priority 7
+															// SysTick priority 6, PendSV priority 7
+															// lowest PRI so only foreground interrupted by a switch
+  NVIC_SYS_PRI3_R =(NVIC_SYS_PRI3_R&0x0000FFFF)|0xC0E00000;
+}
+
+// ******** SysTick_Handler ************
+// end of a time slice, the switch itself happens in PendSV_Handler
+// once no other interrupt is active
+void SysTick_Handler(void){
+#ifdef schedulerProfile
+	SliceCount++;
+#endif
+	NVIC_INT_CTRL_R = NVIC_INT_CTRL_PEND_SV;
 }
 
 void SetInitialStack(int i){
-  tcbs[i].sp = &Stacks[i][STACKSIZE-16]; // thread stack pointer
-  Stacks[i][STACKSIZE-1] = 0x01000000;   // thumb bit
-  Stacks[i][STACKSIZE-3] = 0x14141414;   // R14
-  Stacks[i][STACKSIZE-4] = 0x12121212;   // R12
-  Stacks[i][STACKSIZE-5] = 0x03030303;   // R3
-  Stacks[i][STACKSIZE-6] = 0x02020202;   // R2
-  Stacks[i][STACKSIZE-7] = 0x01010101;   // R1
-  Stacks[i][STACKSIZE-8] = 0x00000000;   // R0
-  Stacks[i][STACKSIZE-9] = 0x11111111;   // R11
-  Stacks[i][STACKSIZE-10] = 0x10101010;  // R10
-  Stacks[i][STACKSIZE-11] = 0x09090909;  // R9
-  Stacks[i][STACKSIZE-12] = 0x08080808;  // R8
-  Stacks[i][STACKSIZE-13] = 0x07070707;  // R7
-  Stacks[i][STACKSIZE-14] = 0x06060606;  // R6
-  Stacks[i][STACKSIZE-15] = 0x05050505;  // R5
-  Stacks[i][STACKSIZE-16] = 0x04040404;  // R4
+  int32_t *stack = tcbs[i].stackBase;
+  uint32_t size = tcbs[i].stackSize/4;  // in 32-bit words
+  tcbs[i].sp = &stack[size-16]; // thread stack pointer
+  stack[size-1] = 0x01000000;   // thumb bit
+  stack[size-3] = 0x14141414;   // R14
+  stack[size-4] = 0x12121212;   // R12
+  stack[size-5] = 0x03030303;   // R3
+  stack[size-6] = 0x02020202;   // R2
+  stack[size-7] = 0x01010101;   // R1
+  stack[size-8] = 0x00000000;   // R0
+  stack[size-9] = 0x11111111;   // R11
+  stack[size-10] = 0x10101010;  // R10
+  stack[size-11] = 0x09090909;  // R9
+  stack[size-12] = 0x08080808;  // R8
+  stack[size-13] = 0x07070707;  // R7
+  stack[size-14] = 0x06060606;  // R6
+  stack[size-15] = 0x05050505;  // R5
+  stack[size-16] = 0x04040404;  // R4
 }
 
 ///******** OS_Launch ***************
@@ -129,11 +819,55 @@ void SetInitialStack(int i){
 //         (maximum of 24 bits)
 // Outputs: none (does not return)
 void OS_Launch(unsigned long theTimeSlice){
+#ifdef idleThread
+	if (AddThread(&IdleTask, IDLESTACKSIZE, IDLEPRIORITY, 0, 0, 0)){
+		IdlePt = RunPt; // find it, AddThread does not return it
+		while (IdlePt->task != &IdleTask){
+			IdlePt = IdlePt->next;
+		}
+	}
+	SlotEnd = OS_Time() + CPULOADSLOTMS*TIME_1MS;
+#endif
+#ifdef threadStats
+	SwitchTime = OS_Time();
+#endif
 	NVIC_ST_RELOAD_R = theTimeSlice - 1; // reload value
   NVIC_ST_CTRL_R = 0x00000007; // enable, core clock and interrupt arm
   StartOS();                   // start on the first task
 }
 
+// ******** OS_CpuLoad ************
+// share of the CPU not spent in the idle thread, interrupts included
+// input:  window in ms, rounded up to CPULOADSLOTMS, at most CPULOADSLOTS slots
+// output: load in 0.1% units over the slots finished so far
+//         0 before the first slot ends or without idleThread
+unsigned long OS_CpuLoad(unsigned long window){
+#ifdef idleThread
+	uint32_t n, i;
+	uint64_t idle = 0;
+	long sr;
+	n = (window + CPULOADSLOTMS - 1)/CPULOADSLOTMS;
+	if (n > CPULOADSLOTS){
+		n = CPULOADSLOTS;
+	}
+	sr = StartCritical();
+	IdleCharge(); // close the slots that passed while no switch happened
+	if (n > IdleSlots){
+		n = IdleSlots;
+	}
+	for (i = 1; i <= n; i++){
+		idle += IdleHistory[(IdleSlots - i)%CPULOADSLOTS];
+	}
+	EndCritical(sr);
+	if (n == 0){
+		return 0;
+	}
+	return 1000 - (unsigned long)(idle*1000/((uint64_t)n*CPULOADSLOTMS*TIME_1MS));
+#else
+	return 0;
+#endif
+}
+
 // ******** OS_Suspend ************
 // suspend execution of currently running thread
 // scheduler will choose another thread to execute
@@ -142,67 +876,225 @@ void OS_Launch(unsigned long theTimeSlice){
 // input:  none
 // output: none
 void OS_Suspend(void) { 
-	NVIC_ST_CURRENT_R  = 0; // reset counter
-	NVIC_INT_CTRL_R = 0x04000000;		// trigger SysTick
+	NVIC_INT_CTRL_R = NVIC_INT_CTRL_PEND_SV;		// trigger PendSV, the time slice keeps running
+	__dsb(0xF);		// make sure the switch is taken before returning
+	__isb(0xF);
 }
 
-//******** OS_AddThread *************** 
-// add a foregound thread to the scheduler
+#ifdef deadlineSched
+uint32_t RtUtilization;	// sum of Wcet/Period of the deadline threads, parts per million
+uint32_t RtThreads;			// deadline threads alive
+uint32_t RtRejects;			// OS_AddDeadlineThread calls refused by the utilization test
+#ifdef rmSched
+// Liu and Layland bound n(2^(1/n)-1) in parts per million, for n = 1 to 20
+static const uint32_t RmBound[20] = {
+	1000000, 828427, 779763, 756828, 743491, 734772, 728626, 724061, 720537, 717734,
+	715451, 713557, 711958, 710592, 709411, 708380, 707472, 706666, 705945, 705298
+};
+#endif
+
+// ******** Admit ************
+// utilization test for one more deadline thread
+// input:  Wcet/Period of the new thread in parts per million
+// output: 1 if the set stays schedulable, 0 if not
+// call with interrupts disabled
+static int Admit(uint32_t utilization){
+	uint32_t limit;
+#ifdef edfSched
+	limit = RTUTILMAX;
+#else
+	limit = RmBound[(RtThreads < 20) ? RtThreads : 19]; // bound for RtThreads+1 threads
+#endif
+	return (utilization <= limit) && (RtUtilization + utilization <= limit);
+}
+#endif
+
+//******** AddThread *************** 
+// add a foregound thread, with a deadline if period is not 0
 // Inputs: pointer to a void/void foreground task
 //         number of bytes allocated for its stack
 //         priority, 0 is highest, 5 is the lowest
+//         period in ms, 0 for a thread without a deadline
+//         CPU budget per period in 12.5ns units
+//         Wcet/Period in parts per million
 // Outputs: 1 if successful, 0 if this thread can not be added
-// stack size must be divisable by 8 (aligned to double word boundary)
+// stack size is rounded up to a multiple of 8 (aligned to double word boundary)
 static uint32_t ThreadNum = 0;
-int OS_AddThread(void(*task)(void), unsigned long stackSize, unsigned long priority){
-	unsigned char i,j;	 
+static int AddThread(void(*task)(void), unsigned long stackSize, unsigned long priority,
+	uint32_t period, uint32_t wcet, uint32_t utilization){
 	int32_t status,thread;
+	int32_t *stack;
+	tcbType *pt;
+#ifdef stackCheck
+	uint32_t k;
+#endif
+	if (stackSize < MINSTACKSIZE){
+		stackSize = MINSTACKSIZE;
+	}
+	stackSize = (stackSize + 7) & ~7; // keep the stack double word aligned
   status = StartCritical();
-  if (ThreadNum == NUMTHREADS){ // no available tcbs
+	stack = 0;
+#ifdef deadlineSched
+	if (period && !Admit(utilization)){
+		RtRejects++;
+		EndCritical(status);
+		return 0;
+	}
+#endif
+	if (FreeTcbs){
+		stack = StackAlloc(stackSize + STACKREDZONE);
+	}
+  if (stack == 0){ // no available tcbs or no room for the stack
 			EndCritical(status);
 	  return 0;
   }
   else{
-	  	if (ThreadNum == 0){  // start add thread
-			tcbs[0].available = 0;
-			tcbs[0].next = &tcbs[0];  // first, create a single cycle
-			RunPt = &tcbs[0]; //start from tcbs[0]
-			thread = 0;
-		}
-		else{   // not the start
-			for (i=0;i<NUMTHREADS;i++){
-				if (tcbs[i].available) break;   // find an available tcb for the new thread
+		pt = FreeTcbs;
+		FreeTcbs = pt->next;
+		pt->available = 0;
+		thread = pt - tcbs;
+		if (ThreadRing == 0){ // the only thread, a single cycle
+			pt->next = pt;
+			pt->prev = pt;
+			ThreadRing = pt;
+			if (RunPt == 0){ // OS_Launch starts on it
+				RunPt = pt;
 			}
-			thread = i;
-			tcbs[i].available = 0; // make this tcb no longer available
-			for (j = (thread + NUMTHREADS - 1)%  NUMTHREADS; j != thread; j = (j + NUMTHREADS - 1) % NUMTHREADS){
-				if (tcbs[j].available == 0) break; // find a previous tcb which has been used
+			else{ // the last thread was killed, Scheduler() steps from it into this one
+				RunPt->next = pt;
 			}
-			// add this tcb into the link list cycle
-			tcbs[thread].next = tcbs[j].next;  
-			tcbs[j].next = &tcbs[thread];
 		}
-		tcbs[thread].id = thread;
+		else{ // link it in at the end of the round
+			pt->next = ThreadRing;
+			pt->prev = ThreadRing->prev;
+			ThreadRing->prev->next = pt;
+			ThreadRing->prev = pt;
+		}
+		tcbs[thread].id = (tcbs[thread].id & ~0xFF) + 0x100 + thread; // a stale ID of the last thread here no longer matches
 		tcbs[thread].WaitTime = 0; // Initially 0
 		tcbs[thread].ArriveTime = OS_MsTime();
 		tcbs[thread].ExecCount = 0; // Initially 0
+		tcbs[thread].task = task;
+#ifdef threadStats
+		tcbs[thread].RunTime = 0;
+		tcbs[thread].IsrTime = 0;
+#endif
 
 #ifdef prioritySched
+#ifdef readyQueue
+		if (priority >= NUMPRIORITIES){
+			priority = NUMPRIORITIES-1;
+		}
+#endif
+#ifdef deadlineSched
+		if (period){
+			priority = 0;
+		}
+		else if (priority == 0){ // priority 0 belongs to deadline threads
+			priority = 1;
+		}
+		tcbs[thread].Period = period;
+		tcbs[thread].Wcet = wcet;
+		tcbs[thread].Utilization = utilization;
+		tcbs[thread].Release = KernelNow();
+		tcbs[thread].Deadline = tcbs[thread].Release + period;
+		tcbs[thread].Jobs = 0;
+		tcbs[thread].DeadlineMisses = 0;
+#ifdef threadStats
+		tcbs[thread].JobStart = 0;
+		tcbs[thread].BudgetOverruns = 0;
+#endif
+		if (period){
+			RtUtilization += utilization;
+			RtThreads++;
+		}
+#endif
 #ifdef aging
+		tcbs[thread].age = 0;
 		tcbs[thread].FixedPriority = priority;
+		tcbs[thread].BasePriority = priority;
 		tcbs[thread].WorkPriority = priority;
 #else
 		tcbs[thread].priority = priority;
 #endif
 #endif
+		tcbs[thread].sleepCt = 0;
+#ifdef blockSema
+		tcbs[thread].blockPt = 0;
+#endif
+#ifdef readyQueue
+		tcbs[thread].waitMutex = 0;
+		tcbs[thread].heldList = 0;
+		tcbs[thread].waitEvents = 0;
+		tcbs[thread].waitList = 0;
+		tcbs[thread].timedOut = 0;
+		tcbs[thread].notifyWait = 0;
+#endif
+		tcbs[thread].notifyValue = 0;
 	
+#ifdef stackCheck
+		for (k = 0; k < STACKREDZONE/4; k++){
+			stack[k] = STACKPAINT;
+		}
+		stack += STACKREDZONE/4; // the guard and the stack are above the red zone
+		for (k = 1; k < stackSize/4; k++){
+			stack[k] = STACKPAINT;
+		}
+		stack[0] = STACKGUARD;
+#endif
+		tcbs[thread].stackBase = stack; // the guard word, StackFree gets the red zone back below it
+		tcbs[thread].stackSize = stackSize;
 		SetInitialStack(thread); 
-		Stacks[thread][STACKSIZE-2] = (int32_t)(task); // PC		
+		stack[stackSize/4-2] = (int32_t)(task); // PC		
+#ifdef readyQueue
+		ReadyInsert(&tcbs[thread]);
+#endif
 		ThreadNum++;
+		TRACE(TRACE_ADD, thread, priority);
 		EndCritical(status);
 		return 1; 
 	}            
 }
+
+//******** OS_AddThread *************** 
+// add a foregound thread to the scheduler
+// Inputs: pointer to a void/void foreground task
+//         number of bytes allocated for its stack
+//         priority, 0 is highest, 5 is the lowest
+// Outputs: 1 if successful, 0 if this thread can not be added
+// stack size is rounded up to a multiple of 8 (aligned to double word boundary)
+// with edfSched or rmSched priority 0 is kept for deadline threads, 1 is used instead
+// with idleThread IDLEPRIORITY is kept for the idle thread, the level above is used instead
+int OS_AddThread(void(*task)(void), unsigned long stackSize, unsigned long priority){
+#ifdef idleThread
+	if (priority >= IDLEPRIORITY){ // kept for the idle thread
+		priority = IDLEPRIORITY-1;
+	}
+#endif
+	return AddThread(task, stackSize, priority, 0, 0, 0);
+}
+
+//******** OS_AddDeadlineThread *************** 
+// add a periodic foreground thread with a deadline at the end of each period
+// the thread ends each job with OS_WaitPeriod()
+// Inputs: pointer to a void/void foreground task
+//         number of bytes allocated for its stack
+//         period in units of 12.5ns, rounded to ms
+//         worst case CPU time per period in units of 12.5ns
+// Outputs: 1 if successful, 0 if the utilization test fails, there is no
+//          room for the thread or edfSched and rmSched are both off
+int OS_AddDeadlineThread(void(*task)(void), unsigned long stackSize, unsigned long period, unsigned long wcet){
+#ifdef deadlineSched
+	uint32_t periodMs = (period + TIME_1MS/2)/TIME_1MS;
+	if (periodMs == 0){
+		periodMs = 1;
+	}
+	return AddThread(task, stackSize, 0, periodMs, wcet,
+		(uint32_t)(((uint64_t)wcet*1000000 + (uint64_t)periodMs*TIME_1MS - 1)/((uint64_t)periodMs*TIME_1MS)));
+#else
+	return 0;
+#endif
+}
 	 
 //******** OS_Id *************** 
 // returns the thread ID for the currently running thread
@@ -212,27 +1104,280 @@ unsigned long OS_Id(void) {
 	return RunPt->id;
 }
 	 
-// ******** OS_Wait ************
-// decrement semaphore 
-// input:  pointer to a counting semaphore
-// output: none
-void OS_Wait(Sema4Type *semaPt){
-#ifdef blockSema
-	OS_DisableInterrupts();
-	semaPt->Value -= 1;
-	if (semaPt->Value < 0){
-		RunPt->blockPt = semaPt;
-		OS_EnableInterrupts();
-		OS_Suspend();
-		OS_DisableInterrupts();
+//******** OS_IsrEnter *************** 
+// call first thing in an interrupt handler so its time is not charged to a thread
+// Inputs: none
+// Outputs: none
+void OS_IsrEnter(void){
+#ifdef threadStats
+	long sr = StartCritical();
+	if (IsrNest == 0){
+		IsrStart = OS_Time();
 	}
-	OS_EnableInterrupts();
+	IsrNest++;
+	EndCritical(sr);
+#endif
+}
+
+//******** OS_IsrExit *************** 
+// call last thing in an interrupt handler that called OS_IsrEnter
+// Inputs: none
+// Outputs: none
+void OS_IsrExit(void){
+#ifdef threadStats
+	long sr = StartCritical();
+	IsrNest--;
+	if (IsrNest == 0){
+		IsrTotal += OS_TimeDifference(IsrStart, OS_Time());
+	}
+	EndCritical(sr);
+#endif
+}
+
+//******** OS_GetThreadStats *************** 
+// snapshot of the CPU time used by each live thread
+// Inputs: array to fill, number of entries in it
+// Outputs: number of entries filled
+unsigned long OS_GetThreadStats(ThreadStatsType *stats, unsigned long max){
+	unsigned long n = 0;
+#ifdef threadStats
+	int i;
+	long sr = StartCritical();
+	ChargeRunPt(); // bring the running thread up to date
+	for (i = 0; (i < NUMTHREADS) && (n < max); i++){
+		if (tcbs[i].available == 0){
+			stats[n].Id = tcbs[i].id;
+			stats[n].Task = tcbs[i].task;
+#ifdef aging
+			stats[n].Priority = tcbs[i].FixedPriority;
+#elif defined(prioritySched)
+			stats[n].Priority = tcbs[i].priority;
+#else
+			stats[n].Priority = 0;
+#endif
+			stats[n].ExecCount = tcbs[i].ExecCount;
+			stats[n].RunTime = tcbs[i].RunTime;
+			stats[n].IsrTime = tcbs[i].IsrTime;
+#ifdef deadlineSched
+			stats[n].DeadlineMisses = tcbs[i].DeadlineMisses;
+			stats[n].BudgetOverruns = tcbs[i].BudgetOverruns;
+#else
+			stats[n].DeadlineMisses = 0;
+			stats[n].BudgetOverruns = 0;
+#endif
+			n++;
+		}
+	}
+	EndCritical(sr);
+#endif
+	return n;
+}
+
+//******** OS_CheckThreads *************** 
+// walk the ring of live threads and the free TCB list and check they agree
+// Inputs: none
+// Outputs: number of live threads, -1 if the ring or the free list is broken
+long OS_CheckThreads(void){
+	tcbType *pt;
+	uint32_t live = 0, free = 0;
+	int ok = 1;
+	long sr = StartCritical();
+	pt = ThreadRing;
+	if (pt){
+		do{
+			if (pt->available || (pt->next->prev != pt) || (live >= NUMTHREADS)){
+				ok = 0;
+				break;
+			}
+			live++;
+			pt = pt->next;
+		} while (pt != ThreadRing);
+	}
+	for (pt = FreeTcbs; pt && ok; pt = pt->next){
+		if ((pt->available == 0) || (free >= NUMTHREADS)){
+			ok = 0;
+		}
+		free++;
+	}
+	if ((live != ThreadNum) || (live + free + (DeadPt ? 1 : 0) != NUMTHREADS)){
+		ok = 0;
+	}
+	EndCritical(sr);
+	return ok ? (long)live : -1;
+}
+
+//******** OS_StackUsage *************** 
+// high-water mark of a thread's stack
+// Inputs: thread ID
+// Outputs: most bytes of the stack ever used, 0 if the ID is not a live thread
+unsigned long OS_StackUsage(unsigned long id){
+#ifdef stackCheck
+	int32_t *stack;
+	uint32_t words, i;
+	if ((IDINDEX(id) >= NUMTHREADS) || tcbs[IDINDEX(id)].available || (tcbs[IDINDEX(id)].id != id)){
+		return 0;
+	}
+	stack = tcbs[IDINDEX(id)].stackBase;
+	words = tcbs[IDINDEX(id)].stackSize/4;
+	for (i = 1; (i < words) && (stack[i] == STACKPAINT); i++){
+	}
+	return (words - i)*4;
+#else
+	return 0;
+#endif
+}
+
+// Lock statistics ------------------------------------------------------------------------
+// Every semaphore and mutex carries LockStatsType counters. OS_InitSemaphore
+// and OS_InitMutex link them into LockList the first time, newest first, so
+// the list only grows and OS_NextLock can walk it while threads run.
+#ifdef semaStats
+LockStatsType *LockList;			// counters of every semaphore and mutex initialized
+#define LOCKTAKEN(statsPt)	((statsPt)->Acquisitions++)	// taken without waiting
+#define LOCKFAILED(statsPt)	((statsPt)->Failed++)			// not taken and did not wait
+#define LOCKWAITSTART()	(RunPt->lockWaitStart = OS_Time())
+#define LOCKWAITED(statsPt,took)	LockWaited(statsPt, took)
+
+// ******** LockWaited ************
+// charge the wait that started at RunPt->lockWaitStart
+// input:  counters of the semaphore or mutex, 1 if the wait took it
+// output: none
+static void LockWaited(LockStatsType *statsPt, int took){
+	uint32_t wait;
+	long sr = StartCritical();
+	wait = OS_TimeDifference(RunPt->lockWaitStart, OS_Time());
+	statsPt->WaitTotal += wait;
+	if (wait > statsPt->WaitMax){
+		statsPt->WaitMax = wait;
+	}
+	if (took){
+		statsPt->Acquisitions++;
+		statsPt->Contended++;
+	}
+	else{
+		statsPt->Failed++;
+	}
+	EndCritical(sr);
+}
+
+// ******** LockClear ************
+// zero the counters of one semaphore or mutex
+// call with interrupts disabled
+static void LockClear(LockStatsType *statsPt){
+	statsPt->Acquisitions = 0;
+	statsPt->Contended = 0;
+	statsPt->Failed = 0;
+	statsPt->WaitMax = 0;
+	statsPt->WaitTotal = 0;
+}
+
+// ******** LockRegister ************
+// clear the counters of a semaphore or mutex and put it on LockList once
+// call with interrupts disabled
+static void LockRegister(LockStatsType *statsPt){
+	LockStatsType *pt;
+	LockClear(statsPt);
+	for (pt = LockList; pt; pt = pt->Next){
+		if (pt == statsPt){ // initialized again
+			return;
+		}
+	}
+	statsPt->Next = LockList;
+	LockList = statsPt;
+}
+#else
+#define LOCKTAKEN(statsPt)
+#define LOCKFAILED(statsPt)
+#define LOCKWAITSTART()
+#define LOCKWAITED(statsPt,took)
+#endif
+
+// ******** OS_NameSemaphore ************
+// ******** OS_NameMutex ************
+// give a semaphore or mutex a name for OS_NextLock, kept by its Init function
+// input:  pointer to the semaphore or mutex, string that is never freed
+// output: none
+void OS_NameSemaphore(Sema4Type *semaPt, const char *name){
+#ifdef semaStats
+	semaPt->Stats.Name = name;
+#else
+	(void)semaPt; (void)name;
+#endif
+}
+void OS_NameMutex(MutexType *mutexPt, const char *name){
+#ifdef semaStats
+	mutexPt->Stats.Name = name;
 #else
+	(void)mutexPt; (void)name;
+#endif
+}
+
+// ******** OS_NextLock ************
+// walk the counters of every initialized semaphore and mutex
+// input:  0 for the first one, or the previous result
+// output: the next counters, 0 after the last one or without semaStats
+LockStatsType *OS_NextLock(LockStatsType *statsPt){
+#ifdef semaStats
+	return statsPt ? statsPt->Next : LockList;
+#else
+	return 0;
+#endif
+}
+
+// ******** OS_ClearLockStats ************
+// zero the counters of every semaphore and mutex, names are kept
+// input:  none
+// output: none
+void OS_ClearLockStats(void){
+#ifdef semaStats
+	LockStatsType *pt;
+	long sr;
+	for (pt = LockList; pt; pt = pt->Next){
+		sr = StartCritical();
+		LockClear(pt);
+		EndCritical(sr);
+	}
+#endif
+}
+
+// ******** OS_Wait ************
+// decrement semaphore 
+// input:  pointer to a counting semaphore
+// output: none
+void OS_Wait(Sema4Type *semaPt){
+#ifdef blockSema
 	OS_DisableInterrupts();
-	while (semaPt->Value == 0){
+	TRACE(TRACE_WAIT, RunPt->id, TRACESEMA(semaPt));
+	semaPt->Value -= 1;
+	if (semaPt->Value < 0){
+		TRACE(TRACE_BLOCK, RunPt->id, TRACESEMA(semaPt));
+		LOCKWAITSTART();
+		BlockInsert(semaPt, RunPt);
+#ifdef readyQueue
+		ReadyRemove(RunPt);
+#endif
 		OS_EnableInterrupts();
 		OS_Suspend();
 		OS_DisableInterrupts();
+		LOCKWAITED(&semaPt->Stats, 1);
+	}
+	else{
+		LOCKTAKEN(&semaPt->Stats);
+	}
+	OS_EnableInterrupts();
+#else
+	OS_DisableInterrupts();
+	if (semaPt->Value == 0){
+		LOCKWAITSTART();
+		while (semaPt->Value == 0){
+			OS_EnableInterrupts();
+			OS_Suspend();
+			OS_DisableInterrupts();
+		}
+		LOCKWAITED(&semaPt->Stats, 1);
+	}
+	else{
+		LOCKTAKEN(&semaPt->Stats);
 	}
 	semaPt->Value -= 1;
 	OS_EnableInterrupts();
@@ -247,13 +1392,13 @@ void OS_Signal(Sema4Type *semaPt){
 #ifdef blockSema
 	tcbType *pt;
 	OS_DisableInterrupts();
+	TRACE(TRACE_SIGNAL, TRACEID, TRACESEMA(semaPt));
 	semaPt->Value += 1;
 	if (semaPt->Value <= 0){
-		pt = RunPt->next;
-		while (pt->blockPt != semaPt){
-			pt = pt->next;
-		}
-		pt->blockPt = 0; // wake up this one
+		pt = BlockRemove(semaPt); // wake up the highest priority waiter
+#ifdef readyQueue
+		ReadyWake(pt);
+#endif
 	}
 	OS_EnableInterrupts();
 #else
@@ -270,72 +1415,835 @@ void OS_Signal(Sema4Type *semaPt){
 void OS_InitSemaphore(Sema4Type *semaPt, long value){
 	OS_DisableInterrupts();
 	semaPt->Value = value;
+	semaPt->BlockedList = 0;
+	semaPt->Timeouts = 0;
+#ifdef semaStats
+	LockRegister(&semaPt->Stats);
+#endif
+	OS_EnableInterrupts();
+}
+
+// ******** OS_bWait ************
+// input:  pointer to a binary semaphore
+// output: none
+void OS_bWait(Sema4Type *semaPt){
+#ifdef blockSema
+	OS_DisableInterrupts();
+	TRACE(TRACE_WAIT, RunPt->id, TRACESEMA(semaPt));
+	semaPt->Value -= 1;
+	if (semaPt->Value < 0){
+		TRACE(TRACE_BLOCK, RunPt->id, TRACESEMA(semaPt));
+		LOCKWAITSTART();
+		BlockInsert(semaPt, RunPt);
+#ifdef readyQueue
+		ReadyRemove(RunPt);
+#endif
+		OS_EnableInterrupts();
+		OS_Suspend();
+		OS_DisableInterrupts();
+		LOCKWAITED(&semaPt->Stats, 1);
+	}
+	else{
+		LOCKTAKEN(&semaPt->Stats);
+	}
+	OS_EnableInterrupts();
+#else
+	OS_DisableInterrupts();
+	if (semaPt->Value == 0){
+		LOCKWAITSTART();
+		while (semaPt->Value == 0){
+			OS_EnableInterrupts();
+			OS_Suspend();
+			OS_DisableInterrupts();
+		}
+		LOCKWAITED(&semaPt->Stats, 1);
+	}
+	else{
+		LOCKTAKEN(&semaPt->Stats);
+	}
+	semaPt->Value = 0;
+	OS_EnableInterrupts();
+#endif
+}	
+
+// ******** WaitTimeout ************
+// OS_Wait or OS_bWait that gives up after timeout ms
+// input:  pointer to a semaphore, ms to wait, OS_NO_WAIT or OS_WAIT_FOREVER,
+//         1 for a binary semaphore
+// output: 1 if the semaphore was taken, 0 if the time ran out
+static int WaitTimeout(Sema4Type *semaPt, unsigned long timeout, int binary){
+#if defined(blockSema) && defined(readyQueue) && defined(sleepQueue)
+	long sr = StartCritical();
+	TRACE(TRACE_WAIT, RunPt->id, TRACESEMA(semaPt));
+	if (semaPt->Value > 0){
+		semaPt->Value -= 1;
+		LOCKTAKEN(&semaPt->Stats);
+		EndCritical(sr);
+		return 1;
+	}
+	if (timeout == OS_NO_WAIT){
+		semaPt->Timeouts++;
+		LOCKFAILED(&semaPt->Stats);
+		EndCritical(sr);
+		return 0;
+	}
+	semaPt->Value -= 1;
+	TRACE(TRACE_BLOCK, RunPt->id, TRACESEMA(semaPt));
+	LOCKWAITSTART();
+	RunPt->blockPt = semaPt;
+	WaitTimed(&semaPt->BlockedList, timeout); // the sleep queue undoes the decrement if it runs out
+	EndCritical(sr);
+	OS_Suspend();
+	LOCKWAITED(&semaPt->Stats, !RunPt->timedOut);
+	return !RunPt->timedOut;
+#else
+	unsigned long start = OS_MsTime();
+	OS_DisableInterrupts();
+	if (semaPt->Value <= 0){
+		LOCKWAITSTART();
+		while (semaPt->Value <= 0){
+			if ((timeout != OS_WAIT_FOREVER) && (OS_MsTime() - start >= timeout)){
+				semaPt->Timeouts++;
+				LOCKWAITED(&semaPt->Stats, 0);
+				OS_EnableInterrupts();
+				return 0;
+			}
+			OS_EnableInterrupts();
+			OS_Suspend();
+			OS_DisableInterrupts();
+		}
+		LOCKWAITED(&semaPt->Stats, 1);
+	}
+	else{
+		LOCKTAKEN(&semaPt->Stats);
+	}
+	if (binary){
+		semaPt->Value = 0;
+	}
+	else{
+		semaPt->Value -= 1;
+	}
+	OS_EnableInterrupts();
+	return 1;
+#endif
+}
+
+// ******** OS_WaitTimeout ************
+// decrement a counting semaphore, giving up after timeout ms
+// input:  pointer to a counting semaphore, ms to wait, OS_NO_WAIT or OS_WAIT_FOREVER
+// output: 1 if the semaphore was taken, 0 if the time ran out
+int OS_WaitTimeout(Sema4Type *semaPt, unsigned long timeout){
+	return WaitTimeout(semaPt, timeout, 0);
+}
+
+// ******** OS_bWaitTimeout ************
+// take a binary semaphore, giving up after timeout ms
+// input:  pointer to a binary semaphore, ms to wait, OS_NO_WAIT or OS_WAIT_FOREVER
+// output: 1 if the semaphore was taken, 0 if the time ran out
+int OS_bWaitTimeout(Sema4Type *semaPt, unsigned long timeout){
+	return WaitTimeout(semaPt, timeout, 1);
+}
+
+// ******** OS_bTry ************
+// input:  pointer to a binary semaphore
+// output: 0 if acquire failed, 1 if succeeded
+uint16_t OS_bTry(Sema4Type *semaPt){
+	OS_DisableInterrupts();
+	if (semaPt->Value == 0){
+		LOCKFAILED(&semaPt->Stats);
+		OS_EnableInterrupts();
+		return 0;
+	}
+	semaPt->Value = 0;
+	LOCKTAKEN(&semaPt->Stats);
+	OS_EnableInterrupts();
+	return 1;
+}	
+
+// ******** OS_bSignal ************
+// input:  pointer to a binary semaphore
+// output: none
+void OS_bSignal(Sema4Type *semaPt){
+#ifdef blockSema
+	tcbType *pt;
+	OS_DisableInterrupts();
+	TRACE(TRACE_SIGNAL, TRACEID, TRACESEMA(semaPt));
+	(semaPt->Value)++;
+	if(semaPt->Value > 1)
+		semaPt->Value = 1;
+	if (semaPt->Value <= 0){
+		pt = BlockRemove(semaPt); // wake up the highest priority waiter
+#ifdef readyQueue
+		ReadyWake(pt);
+#endif
+	}
+	OS_EnableInterrupts();
+#else
+	OS_DisableInterrupts();
+	semaPt->Value = 1;
+	OS_EnableInterrupts();
+#endif
+}
+
+#ifdef readyQueue
+// ******** ChangePriority ************
+// set the working priority of a thread and keep the list it is on in order
+// call with interrupts disabled
+static void ChangePriority(tcbType *pt, uint32_t priority){
+	if (pt->ready){
+		ReadyRemove(pt);
+		pt->WorkPriority = priority;
+		ReadyInsert(pt);
+	}
+	else if (pt->blockPt){
+		WaitRemove(&pt->blockPt->BlockedList, pt);
+		pt->WorkPriority = priority;
+		WaitInsert(&pt->blockPt->BlockedList, pt);
+	}
+	else if (pt->waitMutex){
+		WaitRemove(&pt->waitMutex->BlockedList, pt);
+		pt->WorkPriority = priority;
+		WaitInsert(&pt->waitMutex->BlockedList, pt);
+	}
+	else if (pt->waitEvents){
+		WaitRemove(&pt->waitEvents->BlockedList, pt);
+		pt->WorkPriority = priority;
+		WaitInsert(&pt->waitEvents->BlockedList, pt);
+	}
+	else if (pt->waitList){
+		WaitRemove(pt->waitList, pt);
+		pt->WorkPriority = priority;
+		WaitInsert(pt->waitList, pt);
+	}
+	else{ // sleeping
+		pt->WorkPriority = priority;
+	}
+}
+
+// ******** MutexTake ************
+// make a thread the owner of a free mutex
+// call with interrupts disabled
+static void MutexTake(MutexType *mutexPt, tcbType *pt){
+	mutexPt->Owner = pt;
+	mutexPt->NextHeld = pt->heldList;
+	pt->heldList = mutexPt;
+	mutexPt->LockTime = OS_Time();
+}
+#endif
+
+// ******** OS_InitMutex ************
+// initialize a free mutex and clear its statistics
+// input:  pointer to a mutex
+// output: none
+void OS_InitMutex(MutexType *mutexPt){
+	long sr = StartCritical();
+	mutexPt->Owner = 0;
+	mutexPt->BlockedList = 0;
+	mutexPt->NextHeld = 0;
+	mutexPt->LockTime = 0;
+	mutexPt->MaxHold = 0;
+	mutexPt->Inherits = 0;
+	mutexPt->BadUnlocks = 0;
+#ifdef semaStats
+	LockRegister(&mutexPt->Stats);
+#endif
+	EndCritical(sr);
+}
+
+// ******** OS_MutexLock ************
+// take a mutex, blocking until its owner releases it
+// while blocked, the owner (and the owner of any mutex the owner waits on)
+// runs at the priority of this thread if that is higher
+// input:  pointer to a mutex
+// output: none
+void OS_MutexLock(MutexType *mutexPt){
+#ifdef readyQueue
+	MutexType *m;
+	tcbType *owner;
+	uint32_t priority;
+	OS_DisableInterrupts();
+	if (mutexPt->Owner == 0){
+		MutexTake(mutexPt, RunPt);
+		LOCKTAKEN(&mutexPt->Stats);
+		OS_EnableInterrupts();
+		return;
+	}
+	LOCKWAITSTART();
+	priority = RunPt->WorkPriority;
+	m = mutexPt;
+	while (m){ // pass the priority down the chain of owners
+		owner = m->Owner;
+		if (owner->BasePriority <= priority){
+			break;
+		}
+		owner->BasePriority = priority;
+		if (owner->WorkPriority > priority){
+			ChangePriority(owner, priority);
+		}
+		m->Inherits++;
+		m = owner->waitMutex;
+	}
+	WaitInsert(&mutexPt->BlockedList, RunPt);
+	RunPt->waitMutex = mutexPt;
+	ReadyRemove(RunPt);
+	OS_EnableInterrupts();
+	OS_Suspend(); // OS_MutexUnlock hands over ownership before waking us
+	LOCKWAITED(&mutexPt->Stats, 1);
+#else
+	OS_DisableInterrupts();
+	if (mutexPt->Owner){
+		LOCKWAITSTART();
+		while (mutexPt->Owner){
+			OS_EnableInterrupts();
+			OS_Suspend();
+			OS_DisableInterrupts();
+		}
+		LOCKWAITED(&mutexPt->Stats, 1);
+	}
+	else{
+		LOCKTAKEN(&mutexPt->Stats);
+	}
+	mutexPt->Owner = RunPt;
+	mutexPt->LockTime = OS_Time();
+	OS_EnableInterrupts();
+#endif
+}
+
+#ifdef readyQueue
+// ******** MutexRelease ************
+// take a mutex from its owner, drop any priority the owner inherited through
+// it and hand it to the highest priority waiter
+// call with interrupts disabled
+static void MutexRelease(MutexType *mutexPt){
+	MutexType **link;
+	MutexType *m;
+	tcbType *pt;
+	uint32_t priority;
+	pt = mutexPt->Owner;
+	link = &pt->heldList;
+	while ((*link) && (*link != mutexPt)){
+		link = &((*link)->NextHeld);
+	}
+	if (*link){
+		*link = mutexPt->NextHeld;
+	}
+	priority = pt->FixedPriority; // highest priority still waiting on what it holds
+	for (m = pt->heldList; m; m = m->NextHeld){
+		if (m->BlockedList && (m->BlockedList->WorkPriority < priority)){
+			priority = m->BlockedList->WorkPriority;
+		}
+	}
+	if (pt->BasePriority != priority){
+		pt->BasePriority = priority;
+		ChangePriority(pt, priority);
+	}
+	if (mutexPt->BlockedList){
+		pt = mutexPt->BlockedList;
+		mutexPt->BlockedList = pt->nextBlocked;
+		pt->waitMutex = 0;
+		MutexTake(mutexPt, pt);
+		ReadyWake(pt);
+	}
+	else{
+		mutexPt->Owner = 0;
+	}
+}
+#endif
+
+// ******** OS_MutexUnlock ************
+// release a mutex held by the running thread, drop any inherited priority
+// and hand the mutex to the highest priority waiter
+// input:  pointer to a mutex
+// output: none
+// an unlock by a thread that does not own the mutex is counted in BadUnlocks and ignored
+void OS_MutexUnlock(MutexType *mutexPt){
+	unsigned long held;
+	OS_DisableInterrupts();
+	if (mutexPt->Owner != RunPt){ // not locked, or locked by another thread
+		mutexPt->BadUnlocks++;
+		OS_EnableInterrupts();
+		return;
+	}
+	held = OS_TimeDifference(mutexPt->LockTime, OS_Time());
+	if (held > mutexPt->MaxHold){
+		mutexPt->MaxHold = held;
+	}
+#ifdef readyQueue
+	MutexRelease(mutexPt);
+#else
+	mutexPt->Owner = 0;
+#endif
 	OS_EnableInterrupts();
 }
 
-// ******** OS_bWait ************
-// input:  pointer to a binary semaphore
-// output: none
-void OS_bWait(Sema4Type *semaPt){
-#ifdef blockSema
-	OS_DisableInterrupts();
-	semaPt->Value -= 1;
-	if (semaPt->Value < 0){
-		RunPt->blockPt = semaPt;
-		OS_EnableInterrupts();
-		OS_Suspend();
-		OS_DisableInterrupts();
+// Event flags ------------------------------------------------------------------------
+
+// ******** FlagsMatch ************
+// 1 if the flags in a group satisfy a wait for mask in the given mode
+static int FlagsMatch(uint32_t flags, uint32_t mask, uint32_t mode){
+	if (mode & OS_FLAGS_ALL){
+		return (flags & mask) == mask;
+	}
+	return (flags & mask) != 0;
+}
+
+// ******** OS_InitEventFlags ************
+// initialize an event flag group
+// input:  pointer to the group, initial value of the 32 flags
+// output: none
+void OS_InitEventFlags(EventFlagsType *eventPt, uint32_t flags){
+	long sr = StartCritical();
+	eventPt->Flags = flags;
+	eventPt->BlockedList = 0;
+	EndCritical(sr);
+}
+
+// ******** OS_SetEventFlags ************
+// set flags in a group and wake every thread whose wait is now satisfied
+// input:  pointer to the group, flags to set
+// output: none
+// can be called from background tasks
+void OS_SetEventFlags(EventFlagsType *eventPt, uint32_t flags){
+	long sr = StartCritical();
+#ifdef readyQueue
+	tcbType **link;
+	tcbType *pt;
+#endif
+	eventPt->Flags |= flags;
+#ifdef readyQueue
+	link = &eventPt->BlockedList;
+	while (*link){ // highest priority waiters get to clear flags first
+		pt = *link;
+		if (FlagsMatch(eventPt->Flags, pt->waitFlags, pt->waitMode)){
+			*link = pt->nextBlocked;
+			pt->waitFlags &= eventPt->Flags;
+			if (pt->waitMode & OS_FLAGS_CLEAR){
+				eventPt->Flags &= ~pt->waitFlags;
+			}
+			pt->waitEvents = 0;
+			ReadyWake(pt);
+		}
+		else{
+			link = &pt->nextBlocked;
+		}
+	}
+#endif
+	EndCritical(sr);
+}
+
+// ******** OS_ClearEventFlags ************
+// clear flags in a group
+// input:  pointer to the group, flags to clear
+// output: none
+// can be called from background tasks
+void OS_ClearEventFlags(EventFlagsType *eventPt, uint32_t flags){
+	long sr = StartCritical();
+	eventPt->Flags &= ~flags;
+	EndCritical(sr);
+}
+
+// ******** OS_WaitEventFlags ************
+// block until any or all of the flags in mask are set
+// input:  pointer to the group, flags to wait for,
+//         OS_FLAGS_ANY or OS_FLAGS_ALL, plus OS_FLAGS_CLEAR to consume them
+// output: the flags in mask that were set when the wait ended
+uint32_t OS_WaitEventFlags(EventFlagsType *eventPt, uint32_t mask, uint32_t mode){
+	uint32_t result;
+	OS_DisableInterrupts();
+#ifdef readyQueue
+	if (!FlagsMatch(eventPt->Flags, mask, mode)){
+		RunPt->waitFlags = mask;
+		RunPt->waitMode = mode;
+		RunPt->waitEvents = eventPt;
+		WaitInsert(&eventPt->BlockedList, RunPt);
+		ReadyRemove(RunPt);
+		OS_EnableInterrupts();
+		OS_Suspend(); // OS_SetEventFlags fills in waitFlags before waking us
+		return RunPt->waitFlags;
+	}
+#else
+	while (!FlagsMatch(eventPt->Flags, mask, mode)){
+		OS_EnableInterrupts();
+		OS_Suspend();
+		OS_DisableInterrupts();
+	}
+#endif
+	result = eventPt->Flags & mask;
+	if (mode & OS_FLAGS_CLEAR){
+		eventPt->Flags &= ~result;
+	}
+	OS_EnableInterrupts();
+	return result;
+}
+
+// Thread notifications -------------------------------------------------------------------
+// Each thread has a 32-bit notification word. OS_Notify indexes tcbs with
+// the low byte of the id and ORs bits into it, and OS_NotifyWait takes the
+// bits of a mask out of the calling thread's own word. There is no list to
+// search or keep, so one-to-one signals need no Sema4Type. The rest of the id
+// counts the reuses of the TCB, so an id kept after its thread was killed
+// does not reach the thread that got the TCB next.
+
+// ******** OS_Notify ************
+// set bits in the notification word of a thread and wake it if it waits for one of them
+// input:  id of the thread from OS_Id, bits to set
+// output: 1 if the thread exists, 0 if not
+// can be called from background tasks and interrupts
+int OS_Notify(unsigned long id, uint32_t bits){
+	tcbType *pt;
+	long sr;
+	if (IDINDEX(id) >= NUMTHREADS){
+		return 0;
+	}
+	pt = &tcbs[IDINDEX(id)];
+	sr = StartCritical();
+	if (pt->available || (pt->id != id)){ // killed, maybe reused by another thread
+		EndCritical(sr);
+		return 0;
+	}
+	pt->notifyValue |= bits;
+#if defined(readyQueue) && defined(sleepQueue)
+	if ((pt->notifyWait & bits) && (pt->ready == 0)){ // not already woken by its timeout
+		pt->notifyWait = 0;
+		if (pt->sleepCt){
+			SleepRemove(pt);
+		}
+		ReadyWake(pt);
+	}
+#endif
+	EndCritical(sr);
+	return 1;
+}
+
+// ******** OS_NotifyWait ************
+// take the bits of mask out of the notification word of the calling thread,
+// waiting for at least one of them to be set
+// input:  bits to wait for, ms to wait, OS_NO_WAIT or OS_WAIT_FOREVER
+// output: the bits of mask that were set, 0 if none were set in time
+uint32_t OS_NotifyWait(uint32_t mask, unsigned long timeout){
+	uint32_t bits;
+	long sr = StartCritical();
+#if defined(readyQueue) && defined(sleepQueue)
+	if (((RunPt->notifyValue & mask) == 0) && (timeout != OS_NO_WAIT)){
+		RunPt->notifyWait = mask;
+		ReadyRemove(RunPt);
+		if (timeout != OS_WAIT_FOREVER){
+			RunPt->sleepCt = timeout;
+			SleepInsert(RunPt, timeout);
+		}
+		EndCritical(sr);
+		OS_Suspend(); // OS_Notify or the sleep queue wakes us
+		sr = StartCritical();
+		RunPt->notifyWait = 0;
+	}
+#else
+	unsigned long start = OS_MsTime();
+	while ((RunPt->notifyValue & mask) == 0){
+		if ((timeout == OS_NO_WAIT) ||
+				((timeout != OS_WAIT_FOREVER) && (OS_MsTime() - start >= timeout))){
+			break;
+		}
+		EndCritical(sr);
+		OS_Suspend();
+		sr = StartCritical();
+	}
+#endif
+	bits = RunPt->notifyValue & mask;
+	RunPt->notifyValue &= ~bits;
+	EndCritical(sr);
+	return bits;
+}
+
+// Message queues ------------------------------------------------------------------------
+// A sender that finds a receiver waiting copies straight into its buffer, and
+// a receiver that frees a slot moves the first waiting sender's message in,
+// so a thread that wakes up has always succeeded unless its wait timed out.
+// Timed waits sit on the wait list and in the sleep queue at the same time;
+// whichever ends the wait takes the thread off the other.
+
+
+// ******** OS_InitMsgQueue ************
+// initialize an empty message queue
+// input:  pointer to the queue, buffer of msgSize*depth bytes,
+//         bytes per message, number of messages
+// output: none
+void OS_InitMsgQueue(MsgQueueType *queuePt, void *buffer, unsigned long msgSize, unsigned long depth){
+	long sr = StartCritical();
+	queuePt->Buffer = buffer;
+	queuePt->MsgSize = msgSize;
+	queuePt->Depth = depth;
+	queuePt->Count = 0;
+	queuePt->GetI = 0;
+	queuePt->SendList = 0;
+	queuePt->RecvList = 0;
+	queuePt->Sent = 0;
+	queuePt->Full = 0;
+	queuePt->Timeouts = 0;
+	EndCritical(sr);
+}
+
+// ******** MsgPut ************
+// copy a message behind the newest one, queue must not be full
+// call with interrupts disabled
+static void MsgPut(MsgQueueType *queuePt, const void *msg){
+	unsigned long i = queuePt->GetI + queuePt->Count;
+	if (i >= queuePt->Depth){
+		i -= queuePt->Depth;
+	}
+	memcpy(&queuePt->Buffer[i*queuePt->MsgSize], msg, queuePt->MsgSize);
+	queuePt->Count++;
+	queuePt->Sent++;
+}
+
+// ******** MsgGet ************
+// copy the oldest message out, queue must not be empty
+// call with interrupts disabled
+static void MsgGet(MsgQueueType *queuePt, void *msg){
+	memcpy(msg, &queuePt->Buffer[queuePt->GetI*queuePt->MsgSize], queuePt->MsgSize);
+	queuePt->GetI++;
+	if (queuePt->GetI == queuePt->Depth){
+		queuePt->GetI = 0;
+	}
+	queuePt->Count--;
+}
+
+// ******** OS_MsgSend ************
+// copy a message into a queue, or straight to the thread waiting for one
+// input:  pointer to the queue, message of MsgSize bytes,
+//         ms to wait for room, OS_NO_WAIT or OS_WAIT_FOREVER
+// output: 1 if sent, 0 if the queue stayed full
+// with OS_NO_WAIT it can be called from background tasks and interrupts
+int OS_MsgSend(MsgQueueType *queuePt, const void *msg, unsigned long timeout){
+	long sr = StartCritical();
+#if defined(readyQueue) && defined(sleepQueue)
+	tcbType *pt;
+	if (queuePt->RecvList){ // the queue is empty, hand it over
+		pt = WaitWake(&queuePt->RecvList);
+		memcpy(pt->waitMsg, msg, queuePt->MsgSize);
+		queuePt->Sent++;
+	}
+	else if (queuePt->Count < queuePt->Depth){
+		MsgPut(queuePt, msg);
+	}
+	else if ((timeout == OS_NO_WAIT) || (NVIC_INT_CTRL_R & NVIC_INT_CTRL_VEC_ACT_M)){
+		queuePt->Full++;
+		EndCritical(sr);
+		return 0;
+	}
+	else{
+		RunPt->waitMsg = (void *)msg;
+		WaitTimed(&queuePt->SendList, timeout);
+		EndCritical(sr);
+		OS_Suspend(); // a receiver moves the message in before waking us
+		if (RunPt->timedOut){
+			sr = StartCritical(); // other threads and tasks update the queue too
+			queuePt->Timeouts++;
+			EndCritical(sr);
+			return 0;
+		}
+		return 1;
+	}
+#else
+	unsigned long start = OS_MsTime();
+	while (queuePt->Count == queuePt->Depth){
+		if ((timeout == OS_NO_WAIT) || (NVIC_INT_CTRL_R & NVIC_INT_CTRL_VEC_ACT_M)){
+			queuePt->Full++;
+			EndCritical(sr);
+			return 0;
+		}
+		if ((timeout != OS_WAIT_FOREVER) && (OS_MsTime() - start >= timeout)){
+			queuePt->Timeouts++;
+			EndCritical(sr);
+			return 0;
+		}
+		EndCritical(sr);
+		OS_Suspend();
+		sr = StartCritical();
+	}
+	MsgPut(queuePt, msg);
+#endif
+	EndCritical(sr);
+	return 1;
+}
+
+// ******** OS_MsgReceive ************
+// copy the oldest message out of a queue
+// input:  pointer to the queue, place for MsgSize bytes,
+//         ms to wait for a message, OS_NO_WAIT or OS_WAIT_FOREVER
+// output: 1 if a message was received, 0 if the queue stayed empty
+int OS_MsgReceive(MsgQueueType *queuePt, void *msg, unsigned long timeout){
+	long sr = StartCritical();
+#if defined(readyQueue) && defined(sleepQueue)
+	tcbType *pt;
+	if (queuePt->Count){
+		MsgGet(queuePt, msg);
+		if (queuePt->SendList){ // the slot goes to the first waiting sender
+			pt = WaitWake(&queuePt->SendList);
+			MsgPut(queuePt, pt->waitMsg);
+		}
+	}
+	else if (timeout == OS_NO_WAIT){
+		EndCritical(sr);
+		return 0;
+	}
+	else{
+		RunPt->waitMsg = msg;
+		WaitTimed(&queuePt->RecvList, timeout);
+		EndCritical(sr);
+		OS_Suspend(); // a sender copies the message before waking us
+		if (RunPt->timedOut){
+			sr = StartCritical(); // other threads and tasks update the queue too
+			queuePt->Timeouts++;
+			EndCritical(sr);
+			return 0;
+		}
+		return 1;
+	}
+#else
+	unsigned long start = OS_MsTime();
+	while (queuePt->Count == 0){
+		if ((timeout == OS_NO_WAIT) ||
+		    ((timeout != OS_WAIT_FOREVER) && (OS_MsTime() - start >= timeout))){
+			if (timeout != OS_NO_WAIT){
+				queuePt->Timeouts++;
+			}
+			EndCritical(sr);
+			return 0;
+		}
+		EndCritical(sr);
+		OS_Suspend();
+		sr = StartCritical();
+	}
+	MsgGet(queuePt, msg);
+#endif
+	EndCritical(sr);
+	return 1;
+}
+
+// ******** OS_MsgCount ************
+// number of messages in a queue
+// input:  pointer to the queue
+// output: 0 to Depth
+unsigned long OS_MsgCount(MsgQueueType *queuePt){
+	return queuePt->Count;
+}
+
+// Memory pools ------------------------------------------------------------------------
+// Free blocks are linked through their own first word, so a pool needs no
+// memory besides its buffer and allocating or freeing is a push or a pop
+// with interrupts disabled. A block freed while threads wait goes straight
+// to the first of them, like a message to a waiting receiver.
+
+// ******** OS_InitPool ************
+// split a buffer into a pool of free blocks
+// input:  pointer to the pool, word aligned buffer of blockSize*blocks bytes,
+//         bytes per block, a multiple of 4, number of blocks
+// output: none
+void OS_InitPool(MemPoolType *poolPt, void *buffer, unsigned long blockSize, unsigned long blocks){
+	uint8_t *block = (uint8_t *)buffer + blockSize*blocks;
+	unsigned long i;
+	long sr = StartCritical();
+	poolPt->FreeList = 0;
+	for (i = 0; i < blocks; i++){ // push from the end so the first block is handed out first
+		block -= blockSize;
+		*(void **)block = poolPt->FreeList;
+		poolPt->FreeList = block;
+	}
+	poolPt->BlockSize = blockSize;
+	poolPt->Blocks = blocks;
+	poolPt->Free = blocks;
+	poolPt->MinFree = blocks;
+	poolPt->Empty = 0;
+	poolPt->Timeouts = 0;
+	poolPt->WaitList = 0;
+	EndCritical(sr);
+}
+
+// ******** PoolGet ************
+// pop a block, pool must not be empty
+// call with interrupts disabled
+static void *PoolGet(MemPoolType *poolPt){
+	void *block = poolPt->FreeList;
+	poolPt->FreeList = *(void **)block;
+	poolPt->Free--;
+	if (poolPt->Free < poolPt->MinFree){
+		poolPt->MinFree = poolPt->Free;
+	}
+	return block;
+}
+
+// ******** OS_PoolAlloc ************
+// take a block out of a pool
+// input:  pointer to the pool, ms to wait for a block, OS_NO_WAIT or OS_WAIT_FOREVER
+// output: the block, 0 if the pool stayed empty
+// with OS_NO_WAIT it can be called from background tasks and interrupts
+void *OS_PoolAlloc(MemPoolType *poolPt, unsigned long timeout){
+	void *block;
+	long sr = StartCritical();
+#if defined(readyQueue) && defined(sleepQueue)
+	if (poolPt->FreeList){
+		block = PoolGet(poolPt);
+	}
+	else if ((timeout == OS_NO_WAIT) || (NVIC_INT_CTRL_R & NVIC_INT_CTRL_VEC_ACT_M)){
+		poolPt->Empty++;
+		EndCritical(sr);
+		return 0;
+	}
+	else{
+		WaitTimed(&poolPt->WaitList, timeout);
+		EndCritical(sr);
+		OS_Suspend(); // OS_PoolFree puts the block in waitMsg before waking us
+		if (RunPt->timedOut){
+			sr = StartCritical(); // other threads and tasks update the pool too
+			poolPt->Timeouts++;
+			EndCritical(sr);
+			return 0;
+		}
+		return RunPt->waitMsg;
 	}
-	OS_EnableInterrupts();
 #else
-	OS_DisableInterrupts();
-	while (semaPt->Value == 0){
-		OS_EnableInterrupts();
+	unsigned long start = OS_MsTime();
+	while (poolPt->FreeList == 0){
+		if ((timeout == OS_NO_WAIT) || (NVIC_INT_CTRL_R & NVIC_INT_CTRL_VEC_ACT_M)){
+			poolPt->Empty++;
+			EndCritical(sr);
+			return 0;
+		}
+		if ((timeout != OS_WAIT_FOREVER) && (OS_MsTime() - start >= timeout)){
+			poolPt->Timeouts++;
+			EndCritical(sr);
+			return 0;
+		}
+		EndCritical(sr);
 		OS_Suspend();
-		OS_DisableInterrupts();
+		sr = StartCritical();
 	}
-	semaPt->Value = 0;
-	OS_EnableInterrupts();
+	block = PoolGet(poolPt);
 #endif
-}	
-
-// ******** OS_bTry ************
-// input:  pointer to a binary semaphore
-// output: 0 if acquire failed, 1 if succeeded
-uint16_t OS_bTry(Sema4Type *semaPt){
-	OS_DisableInterrupts();
-	if (semaPt->Value == 0){
-		OS_EnableInterrupts();
-		return 0;
-	}
-	semaPt->Value = 0;
-	OS_EnableInterrupts();
-	return 1;
-}	
+	EndCritical(sr);
+	return block;
+}
 
-// ******** OS_bSignal ************
-// input:  pointer to a binary semaphore
+// ******** OS_PoolFree ************
+// give a block back, or straight to the thread waiting for one
+// input:  pointer to the pool, block from OS_PoolAlloc of the same pool
 // output: none
-void OS_bSignal(Sema4Type *semaPt){
-#ifdef blockSema
+// can be called from background tasks and interrupts
+void OS_PoolFree(MemPoolType *poolPt, void *block){
+	long sr = StartCritical();
+#if defined(readyQueue) && defined(sleepQueue)
 	tcbType *pt;
-	OS_DisableInterrupts();
-	(semaPt->Value)++;
-	if(semaPt->Value > 1)
-		semaPt->Value = 1;
-	if (semaPt->Value <= 0){
-		pt = RunPt->next;
-		while (pt->blockPt != semaPt){
-			pt = pt->next;
-		}
-		pt->blockPt = 0; // wake up this one
+	if (poolPt->WaitList){
+		pt = WaitWake(&poolPt->WaitList);
+		pt->waitMsg = block;
+		EndCritical(sr);
+		return;
 	}
-	OS_EnableInterrupts();
-#else
-	OS_DisableInterrupts();
-	semaPt->Value = 1;
-	OS_EnableInterrupts();
 #endif
+	*(void **)block = poolPt->FreeList;
+	poolPt->FreeList = block;
+	poolPt->Free++;
+	EndCritical(sr);
 }
 
 // ******** OS_Sleep ************
@@ -344,30 +2252,221 @@ void OS_bSignal(Sema4Type *semaPt){
 // output: none
 // OS_Sleep(0) implements cooperative multitasking
 void OS_Sleep(unsigned long sleepTime){
-	RunPt->sleepCt = sleepTime;
+	long sr;
+	if (sleepTime){
+		sr = StartCritical();
+		RunPt->sleepCt = sleepTime;
+#ifdef readyQueue
+		ReadyRemove(RunPt); // Timer2A_Handler puts it back when it is due
+#endif
+#ifdef sleepQueue
+#ifdef tickless
+		TickCatchUp();      // sleepTime counts from now, not from the last interrupt
+#endif
+		SleepInsert(RunPt, sleepTime);
+#ifdef tickless
+		TickRestart();      // this thread may now be the first to wake
+#endif
+#endif
+		EndCritical(sr);
+	}
+	OS_Suspend();
+}
+
+// ******** OS_WaitPeriod ************
+// end the current job of a deadline thread and sleep until its next release
+// a job that ends after its deadline counts as a miss, and releases that
+// already passed are skipped and counted as misses too
+// does nothing but OS_Suspend() for a thread without a deadline
+// input:  none
+// output: none
+void OS_WaitPeriod(void){
+#ifdef deadlineSched
+	long sr;
+	uint32_t now;
+	sr = StartCritical();
+	now = KernelNow();
+	if (RunPt->Period){
+		RunPt->Jobs++;
+		if ((int32_t)(now - RunPt->Deadline) > 0){
+			RunPt->DeadlineMisses++;
+		}
+#ifdef threadStats
+		ChargeRunPt();
+		if (RunPt->RunTime - RunPt->JobStart > RunPt->Wcet){
+			RunPt->BudgetOverruns++;
+		}
+		RunPt->JobStart = RunPt->RunTime;
+#endif
+		RunPt->Release += RunPt->Period;
+		while ((int32_t)(now - RunPt->Release) >= (int32_t)RunPt->Period){ // that job never started
+			RunPt->Release += RunPt->Period;
+			RunPt->DeadlineMisses++;
+		}
+		RunPt->Deadline = RunPt->Release + RunPt->Period;
+		if ((int32_t)(RunPt->Release - now) > 0){
+			EndCritical(sr);
+			OS_Sleep(RunPt->Release - now);
+			return;
+		}
+		ReadyRemove(RunPt); // released already, take its place by the new deadline
+		ReadyInsert(RunPt);
+	}
+	EndCritical(sr);
+#endif
 	OS_Suspend();
 }
 
+// ******** ThreadRemove ************
+// take a thread that no longer waits or runs out of the thread ring, give
+// up its mutexes and leave its TCB and stack for Scheduler() to free
+// call with interrupts disabled
+static void ThreadRemove(tcbType *pt){
+#ifdef readyQueue
+	while (pt->heldList){ // its waiters would hang, and its TCB will be reused
+		MutexRelease(pt->heldList);
+	}
+#endif
+#ifdef deadlineSched
+	if (pt->Period){ // give its share back to the utilization test
+		RtUtilization -= pt->Utilization;
+		RtThreads--;
+	}
+#endif
+	DeadPt = pt; // TCB and stack are in use until Scheduler() has switched away
+	pt->available = 1;
+	pt->prev->next = pt->next; // pt->next stays, Scheduler() steps from it
+	pt->next->prev = pt->prev;
+	if (ThreadRing == pt){
+		ThreadRing = (pt->next == pt) ? 0 : pt->next;
+	}
+	ThreadNum--;
+}
+
+#ifdef stackCheck
+// ******** ThreadStop ************
+// end a thread whose stack overflowed, from whatever it was waiting on
+// its stack is not freed, the arena header below it may be damaged
+// call with interrupts disabled, from Scheduler() with the thread as RunPt
+static void ThreadStop(tcbType *pt){
+	if (pt->available){ // already killed, only keep its stack
+		pt->stackBase = 0;
+		return;
+	}
+#ifdef readyQueue
+	ReadyRemove(pt); // returns at once if it is not ready
+#endif
+#ifdef sleepQueue
+	if (pt->sleepCt){
+		SleepRemove(pt);
+	}
+#endif
+#ifdef blockSema
+	if (pt->blockPt){ // give back the count it took from the semaphore
+		WaitRemove(&pt->blockPt->BlockedList, pt);
+		pt->blockPt->Value++;
+		pt->blockPt = 0;
+	}
+#endif
+#ifdef readyQueue
+	if (pt->waitMutex){
+		WaitRemove(&pt->waitMutex->BlockedList, pt);
+		pt->waitMutex = 0;
+	}
+	if (pt->waitEvents){
+		WaitRemove(&pt->waitEvents->BlockedList, pt);
+		pt->waitEvents = 0;
+	}
+	if (pt->waitList){
+		WaitRemove(pt->waitList, pt);
+		pt->waitList = 0;
+	}
+	pt->notifyWait = 0;
+#endif
+	TRACE(TRACE_KILL, pt->id, 1);
+	ThreadRemove(pt);
+	pt->stackBase = 0;
+}
+#endif
+
 // ******** OS_Kill ************
 // kill the currently running thread, release its TCB and stack
 // input:  none
 // output: none
+// each mutex it still holds goes to its first waiter, or becomes free
 void OS_Kill(void){
-	unsigned char i;
-	int32_t thread;
-	RunPt->available = 1;
-	thread = OS_Id();
-	for (i = (thread + NUMTHREADS - 1) % NUMTHREADS; i != thread; i = (i + NUMTHREADS - 1) % NUMTHREADS){
-		if (tcbs[i].available == 0) 
-			break;   // find the previous used tcb
+	OS_DisableInterrupts();
+#ifdef readyQueue
+	if (RunPt->ready){
+		ReadyRemove(RunPt);
 	}
-	ThreadNum--;
-    tcbs[i].next = tcbs[thread].next;	
+#endif
+	TRACE(TRACE_KILL, RunPt->id, 0);
+	ThreadRemove(RunPt);
+	OS_EnableInterrupts();
 	OS_Suspend(); // switch the thread
 }	
 
 void Scheduler(void){
-#ifdef blockSema 
+#ifdef schedulerProfile
+	unsigned long startTime = OS_Time();
+	unsigned long elapsed;
+#endif
+#ifdef readyQueue
+	uint32_t p;
+#endif
+#ifdef kernelTrace
+	tcbType *lastPt = RunPt;
+#endif
+#ifdef threadStats
+	ChargeRunPt();
+#endif
+#ifdef idleThread
+	IdleCharge();
+#endif
+#ifdef stackCheck
+	if (RunPt->stackBase && (RunPt->stackBase[0] != STACKGUARD)){ // ran off the bottom of its stack
+		StackOverflows++;
+		StackOverflowId = RunPt->id;
+#ifdef stackHalt
+		while(1){} // interrupts are off, StackOverflowId names the thread
+#else
+		ThreadStop(RunPt);
+#endif
+	}
+#endif
+#ifdef readyQueue
+	if (ReadyBitmap == 0){ // RunPt blocked and nothing else can run, never with idleThread
+		do{ // the interrupts that wake a thread preempt this handler
+			OS_EnableInterrupts();
+			WaitForInterrupt();
+			OS_DisableInterrupts();
+		} while (ReadyBitmap == 0);
+#ifdef threadStats
+		SwitchTime = OS_Time(); // the wait is charged to no thread
+		IsrAtSwitch = IsrTotal;
+#endif
+#ifdef schedulerProfile
+		startTime = OS_Time();
+#endif
+	}
+#ifdef lazyAging
+	if ((int32_t)(KernelNow() - NextAgeTime) >= 0){ // some ready thread is due to rise
+		AgePass(KernelNow());
+	}
+#endif
+	p = __clz(ReadyBitmap);      // highest priority with a ready thread
+	RunPt = ReadyList[p];
+#ifdef deadlineSched
+	if (p)	// priority 0 stays sorted
+#endif
+	ReadyList[p] = RunPt->nextReady; // round robin among equal priority
+	if (RunPt->WorkPriority != RunPt->BasePriority){ // aging boost is used up
+		ReadyRemove(RunPt);
+		RunPt->WorkPriority = RunPt->BasePriority;
+		ReadyInsert(RunPt);
+	}
+#elif defined(blockSema)
 #ifdef prioritySched
 	uint32_t max = 255; // max priority
 	tcbType *pt;
@@ -383,7 +2482,7 @@ void Scheduler(void){
 		pt = pt->next; //  skips at least one
 	} while(RunPt != pt);
 	RunPt = bestPt;
-	RunPt->WorkPriority = RunPt->FixedPriority;			 
+	RunPt->WorkPriority = RunPt->BasePriority;			 
 #else // fixed priority scheduling
 		if ((pt->priority < max) && (pt->blockPt == 0) && (pt->sleepCt == 0)){
 			 max = pt->priority;
@@ -405,11 +2504,293 @@ void Scheduler(void){
 		RunPt = RunPt->next;
 	}
 #endif
+	if (DeadPt && (DeadPt != RunPt)){ // the killed thread's registers are saved, free its TCB and stack
+		if (DeadPt->stackBase){ // 0 after an overflow, the block header may be damaged
+			StackFree(DeadPt->stackBase - STACKREDZONE/4);
+		}
+		DeadPt->next = FreeTcbs;
+		FreeTcbs = DeadPt;
+		DeadPt = 0;
+	}
 	if (RunPt->ExecCount == 0) 
 		RunPt->WaitTime = OS_MsTime() - RunPt->ArriveTime;
 	RunPt->ExecCount += 1;
+#ifdef idleThread
+	if (RunPt == IdlePt){
+		IdleStart = OS_Time();
+	}
+#endif
+#ifdef kernelTrace
+	if (RunPt != lastPt){
+		TRACE(TRACE_SWITCH, RunPt->id, lastPt->id);
+	}
+#endif
+#ifdef schedulerProfile
+	elapsed = OS_TimeDifference(startTime, OS_Time());
+	if (elapsed > SchedMaxTime[ThreadNum]){
+		SchedMaxTime[ThreadNum] = elapsed;
+	}
+	SchedTotalTime[ThreadNum] += elapsed;
+	SchedCount[ThreadNum]++;
+#endif
+}
+
+// Thread pool ------------------------------------------------------------------------
+// Workers are created once and block on JobsAvailable. A job is a function and
+// an argument put in a power-of-2 ring, so submitting one costs an enqueue and
+// a signal instead of a TCB search and stack initialization.
+#define JOBQUEUESIZE	16					// Pending jobs, must be a power of 2
+
+struct job {
+	void (*func)(void *);
+	void *arg;
+};
+typedef struct job jobType;
+
+jobType JobQueue[JOBQUEUESIZE];
+uint32_t volatile JobPutI;		// put next
+uint32_t volatile JobGetI;		// get next
+Sema4Type JobsAvailable;
+
+// ******** PoolWorker ************
+// foreground thread that runs submitted jobs forever
+static void PoolWorker(void){
+	jobType job;
+	long sr;
+	while(1){
+		OS_Wait(&JobsAvailable);
+		sr = StartCritical();
+		job = JobQueue[JobGetI&(JOBQUEUESIZE-1)];
+		JobGetI++;
+		EndCritical(sr);
+		job.func(job.arg);
+	}
+}
+
+//******** OS_InitThreadPool *************** 
+// create the worker threads that run jobs given to OS_SubmitJob
+// Inputs: number of workers
+//         number of bytes allocated for each worker stack
+//         priority of the workers, 0 is highest
+// Outputs: number of workers created
+unsigned long OS_InitThreadPool(unsigned long workers, unsigned long stackSize, unsigned long priority){
+	unsigned long i;
+	OS_InitSemaphore(&JobsAvailable, 0);
+	OS_NameSemaphore(&JobsAvailable, "JobsAvailable");
+	JobPutI = JobGetI = 0;
+	for (i = 0; i < workers; i++){
+		if (OS_AddThread(&PoolWorker, stackSize, priority) == 0){
+			break;
+		}
+	}
+	return i;
+}
+
+//******** OS_SubmitJob *************** 
+// queue a job for the next free pool worker
+// Inputs: function to run, it must return instead of calling OS_Kill
+//         argument passed to the function
+// Outputs: 1 if successful, 0 if the job queue is full
+// can be called from background tasks
+int OS_SubmitJob(void(*func)(void *), void *arg){
+	long sr;
+	sr = StartCritical();
+	if ((JobPutI-JobGetI) & ~(JOBQUEUESIZE-1)){
+		EndCritical(sr);
+		return 0; // full
+	}
+	JobQueue[JobPutI&(JOBQUEUESIZE-1)].func = func;
+	JobQueue[JobPutI&(JOBQUEUESIZE-1)].arg = arg;
+	JobPutI++;
+	EndCritical(sr);
+	OS_Signal(&JobsAvailable);
+	return 1;
+}
+
+#ifdef timerWheel
+// Timer wheel -------------------------------------------------------------------------
+// Timer1A interrupts every OS_TIMERTICK and advances WheelNow. A timer due
+// within 64 ticks sits in the level 0 slot of its exact tick. Later ones sit
+// in a coarser level and are moved down (cascaded) when the level below wraps
+// around, so each tick costs O(1) plus the timers that are due. Timers due in
+// the same tick run highest priority first, so the most urgent task keeps the
+// jitter it had with a timer of its own. Timer1A is stopped while no timer is
+// armed, and WheelNow stands still until the next OS_AddTimer.
+#define WHEELSIZE	(1 << WHEELBITS)
+#define WHEELMASK	(WHEELSIZE - 1)
+
+TimerType *Wheel[WHEELLEVELS][WHEELSIZE];
+TimerType *DueList;							// Timers of the current tick, highest priority first
+uint32_t WheelNow;							// Ticks since the wheel was started
+uint32_t WheelPriority = 8;			// NVIC priority of Timer1A, 8 until the wheel is started
+uint32_t WheelCascades;					// Timers moved to a finer level
+uint32_t WheelTimers;						// Timers armed, Timer1A runs only while this is not 0
+TimerType PeriodicTimers[NUMPERIODIC];
+uint32_t NumPeriodic;
+
+// ******** TimerUnlink ************
+// take a timer off the list it is on
+// call with interrupts disabled
+static void TimerUnlink(TimerType *timerPt){
+	*timerPt->Link = timerPt->Next;
+	if (timerPt->Next){
+		timerPt->Next->Link = timerPt->Link;
+	}
+}
+
+// ******** TimerPush ************
+// put a timer at the front of a list
+// call with interrupts disabled
+static void TimerPush(TimerType **list, TimerType *timerPt){
+	timerPt->Next = *list;
+	if (*list){
+		(*list)->Link = &timerPt->Next;
+	}
+	timerPt->Link = list;
+	*list = timerPt;
+}
+
+// ******** WheelInsert ************
+// file a timer in the slot for its Expires tick
+// Expires must not be before WheelNow, a timer due now goes in the slot being run
+// call with interrupts disabled
+static void WheelInsert(TimerType *timerPt){
+	uint32_t delta = timerPt->Expires - WheelNow;
+	uint32_t level, at;
+	if (delta >= (1u << (WHEELBITS*WHEELLEVELS))){ // beyond the span, park it in the last slot
+		at = WheelNow + (1u << (WHEELBITS*WHEELLEVELS)) - 1;
+		level = WHEELLEVELS - 1;
+	}
+	else{
+		at = timerPt->Expires;
+		level = 0;
+		while (delta >= (1u << (WHEELBITS*(level+1)))){
+			level++;
+		}
+	}
+	TimerPush(&Wheel[level][(at >> (WHEELBITS*level)) & WHEELMASK], timerPt);
+}
+
+// ******** WheelCascade ************
+// move the timers of one coarse slot to the finer levels
+// call with interrupts disabled
+static void WheelCascade(uint32_t level){
+	TimerType *timerPt;
+	TimerType **slot = &Wheel[level][(WheelNow >> (WHEELBITS*level)) & WHEELMASK];
+	while (*slot){
+		timerPt = *slot;
+		TimerUnlink(timerPt);
+		WheelInsert(timerPt);
+		WheelCascades++;
+	}
+}
+
+// ******** TimerDisarm ************
+// mark a timer that has left the wheel as stopped, stop Timer1A after the last one
+// call with interrupts disabled
+static void TimerDisarm(TimerType *timerPt){
+	timerPt->Active = 0;
+	WheelTimers--;
+	if (WheelTimers == 0){
+		TIMER1_CTL_R &= ~TIMER_CTL_TAEN; // no 10kHz interrupt while nothing can be due
+	}
+}
+
+// ******** WheelStart ************
+// run Timer1A at OS_TIMERTICK with the most urgent priority asked for so far
+static void WheelStart(uint32_t priority){
+	long sr = StartCritical();
+	if (WheelPriority == 8){
+		InitTimer1A(OS_TIMERTICK, priority);
+		WheelPriority = priority;
+	}
+	else if (priority < WheelPriority){
+		NVIC_PRI5_R = (NVIC_PRI5_R&0xFFFF00FF)|(priority << 13);
+		WheelPriority = priority;
+	}
+	EndCritical(sr);
+}
+
+// ******** OS_AddTimer ************
+// start a periodic or one-shot background task on the timer wheel
+// Inputs: timer, owned by the caller until it is cancelled or has fired
+//         pointer to a void/void background function
+//         delay to the first call, in system time units (12.5ns)
+//         period between calls in system time units, 0 for one call
+//         priority 0 is the highest, 5 is the lowest
+// Outputs: 1 if successful, 0 if the timer is already running
+// times are rounded to OS_TIMERTICK, the delay to at least one tick
+int OS_AddTimer(TimerType *timerPt, void(*task)(void), unsigned long delay,
+   unsigned long period, unsigned long priority){
+	uint32_t ticks = (delay + OS_TIMERTICK/2)/OS_TIMERTICK;
+	long sr;
+	if (priority > 7){
+		priority = 7;
+	}
+	WheelStart(priority);
+	sr = StartCritical();
+	if (timerPt->Active){
+		EndCritical(sr);
+		return 0;
+	}
+	timerPt->Task = task;
+	timerPt->Period = (period + OS_TIMERTICK/2)/OS_TIMERTICK;
+	if ((period != 0) && (timerPt->Period == 0)){
+		timerPt->Period = 1;
+	}
+	timerPt->Priority = priority;
+	timerPt->Runs = 0;
+	timerPt->Expires = WheelNow + (ticks ? ticks : 1);
+	timerPt->Active = 1;
+	WheelInsert(timerPt);
+	WheelTimers++;
+	if (WheelTimers == 1){ // stopped while the wheel was empty
+		TIMER1_CTL_R |= TIMER_CTL_TAEN;
+	}
+	EndCritical(sr);
+	return 1;
+}
+
+// ******** OS_CancelTimer ************
+// stop a timer, it will not be called again
+// Inputs: timer
+// Outputs: none
+// can be called from background tasks, including the timer's own task
+void OS_CancelTimer(TimerType *timerPt){
+	long sr = StartCritical();
+	if (timerPt->Active){
+		TimerUnlink(timerPt);
+		TimerDisarm(timerPt);
+	}
+	EndCritical(sr);
 }
 
+//******** OS_AddPeriodicThread *************** 
+// add a background periodic task
+// typically this function receives the highest priority
+// Inputs: pointer to a void/void background function
+//         period given in system time units (12.5ns)
+//         priority 0 is the highest, 5 is the lowest
+// Outputs: 1 if successful, 0 if this thread can not be added
+// The period is rounded to OS_TIMERTICK, up to NUMPERIODIC tasks
+// It is assumed that the user task will run to completion and return
+// This task can not spin, block, loop, sleep, or kill
+// This task can call OS_Signal  OS_bSignal	 OS_AddThread
+// This task does not have a Thread ID
+int OS_AddPeriodicThread(void(*task)(void), 
+   unsigned long period, unsigned long priority) { 
+	TimerType *timerPt;
+	long sr = StartCritical();
+	if ((NumPeriodic == NUMPERIODIC) || (period == 0)){
+		EndCritical(sr);
+		return 0;
+	}
+	timerPt = &PeriodicTimers[NumPeriodic];
+	NumPeriodic++;
+	EndCritical(sr);
+	return OS_AddTimer(timerPt, task, period, period, priority);
+}
+#else
 //******** OS_AddPeriodicThread *************** 
 // add a background periodic task
 // typically this function receives the highest priority
@@ -436,6 +2817,7 @@ int OS_AddPeriodicThread(void(*task)(void),
 	PeriodTaskCt++;
   return 1;
 }
+#endif
 
 
 // Timing Functions ------------------------------------------------------------------------------
@@ -451,6 +2833,51 @@ unsigned long OS_Time(void) {
 	return TIMER3_TAILR_R - TIMER3_TAV_R;
 }
 
+// Timer3A counts down through all 2^32 values, its timeout interrupt adds
+// the upper 32 bits
+static uint32_t TimeHigh;
+
+// ******** OS_Time64 ************
+// return the time since OS_Init, never wraps and is never reset
+// Inputs:  none
+// Outputs: time in 12.5ns units
+// can be called with interrupts disabled and from any interrupt
+uint64_t OS_Time64(void){
+	uint32_t high, low;
+	long sr = StartCritical();
+	high = TimeHigh;
+	low = OS_Time();
+	if (TIMER3_RIS_R & TIMER_RIS_TATORIS){ // wrapped, Timer3A_Handler has not run yet
+		high++;
+		low = OS_Time(); // read again, the first read may be from before the wrap
+	}
+	EndCritical(sr);
+	return ((uint64_t)high << 32) | low;
+}
+
+// ******** OS_Debounce ************
+// accept an event only if the last accepted one is at least holdoff ago
+// Inputs:  debounce state, zero before the first event
+//          holdoff in 12.5ns units
+// Outputs: 1 if accepted, 0 if it came too soon
+// uses OS_Time64, so OS_ClearMsTime does not affect it; safe in interrupts
+int OS_Debounce(DebounceType *debouncePt, unsigned long holdoff){
+	uint64_t now;
+	int accept;
+	long sr = StartCritical();
+	now = OS_Time64();
+	accept = (debouncePt->Accepted == 0) || (now - debouncePt->Last >= holdoff);
+	if (accept){
+		debouncePt->Last = now;
+		debouncePt->Accepted++;
+	}
+	else{
+		debouncePt->Rejected++;
+	}
+	EndCritical(sr);
+	return accept;
+}
+
 // ******** OS_TimeDifference ************
 // Calculates difference between two times
 // Inputs:  two times measured with OS_Time
@@ -464,13 +2891,67 @@ unsigned long OS_TimeDifference(unsigned long start, unsigned long stop) {
 
 // Ms time system
 static uint32_t MSTime;
+
+#ifdef tickless
+// Timer2A is loaded one-shot to end at the next wakeup instead of every 1 ms.
+// MSTime is only brought up to date at the end of each interval, and the
+// 12.5ns ticks already spent past the last whole ms are kept in TickPhase.
+#define MAXTICKINTERVAL	50000				// Longest interval in ms, fits the 32-bit timer
+static uint32_t TickInterval;				// ms covered by the running interval
+static uint32_t TickPhase;					// 12.5ns ticks past the last whole ms when it started
+
+// ******** TickElapsed ************
+// 12.5ns ticks since the last whole ms credited to MSTime
+// call with interrupts disabled
+static uint32_t TickElapsed(void){
+	if (TIMER2_RIS_R & TIMER_RIS_TATORIS){ // expired, Timer2A_Handler has not run yet
+		return TickInterval*TIME_1MS;
+	}
+	return TIMER2_TAILR_R - TIMER2_TAV_R + TickPhase;
+}
+
+// ******** TickCatchUp ************
+// credit the part of the running interval that has passed to MSTime and
+// the sleep queue, so a new sleep can be measured from now
+// call with interrupts disabled
+static void TickCatchUp(void){
+	uint32_t ticks = TickElapsed();
+	TIMER2_CTL_R &= ~TIMER_CTL_TAEN;
+	TIMER2_ICR_R = TIMER_ICR_TATOCINT;
+	MSTime += ticks/TIME_1MS;
+	KernelMs += ticks/TIME_1MS;
+	SleepAdvance(ticks/TIME_1MS);
+	TickPhase = ticks%TIME_1MS;
+}
+
+// ******** TickRestart ************
+// start a one-shot interval that ends at the next wakeup
+// call with interrupts disabled
+static void TickRestart(void){
+	uint32_t interval = MAXTICKINTERVAL;
+	if (SleepList && (SleepList->sleepDelta < interval)){
+		interval = SleepList->sleepDelta; // at least 1, due threads are already awake
+	}
+	TIMER2_CTL_R &= ~TIMER_CTL_TAEN;
+	TIMER2_TAILR_R = interval*TIME_1MS - TickPhase - 1;
+	TickInterval = interval;
+	TIMER2_CTL_R |= TIMER_CTL_TAEN;
+}
+#endif
+
 // ******** OS_ClearMsTime ************
 // sets the system time to zero
 // Inputs:  none
 // Outputs: none
 // You are free to change how this works
 void OS_ClearMsTime(void) {
+#ifdef tickless
+	long sr = StartCritical();
+	MSTime = 0 - TickElapsed()/TIME_1MS; // OS_MsTime() adds the elapsed part back
+	EndCritical(sr);
+#else
 	MSTime = 0;
+#endif
 }
 
 // ******** OS_MsTime ************
@@ -480,7 +2961,15 @@ void OS_ClearMsTime(void) {
 // You are free to select the time resolution for this function
 // It is ok to make the resolution to match the first call to OS_AddPeriodicThread
 unsigned long OS_MsTime(void) {	
+#ifdef tickless
+	unsigned long time;
+	long sr = StartCritical();
+	time = MSTime + TickElapsed()/TIME_1MS;
+	EndCritical(sr);
+	return time;
+#else
 	return MSTime;
+#endif
 }
 
 // Timers ------------------------------------------------------------------------------
@@ -512,10 +3001,64 @@ void InitTimer1A(unsigned long period, uint32_t priority) {
   EndCritical(sr);
 }
 
+#ifdef timerWheel
+// one wheel tick, run the timers that are due
+void Timer1A_Handler(void){ 
+	TimerType *timerPt;
+	TimerType **link;
+	uint32_t level;
+	long sr;
+	OS_IsrEnter();
+  TIMER1_ICR_R = TIMER_ICR_TATOCINT;// acknowledge timer1A timeout
+	sr = StartCritical();
+	WheelNow++;
+	level = 0;
+	while ((level < WHEELLEVELS-1) && ((WheelNow & ((1u << (WHEELBITS*(level+1))) - 1)) == 0)){
+		level++; // a finer level wrapped around
+	}
+	while (level > 0){ // coarsest first, its timers may land in the finer slot cascaded next
+		WheelCascade(level);
+		level--;
+	}
+	while (Wheel[0][WheelNow & WHEELMASK]){ // sort what is due by priority
+		timerPt = Wheel[0][WheelNow & WHEELMASK];
+		TimerUnlink(timerPt);
+		link = &DueList;
+		while ((*link) && ((*link)->Priority <= timerPt->Priority)){
+			link = &(*link)->Next;
+		}
+		TimerPush(link, timerPt);
+	}
+	while (DueList){
+		timerPt = DueList;
+		TimerUnlink(timerPt);
+		if (timerPt->Period){
+			timerPt->Expires += timerPt->Period; // from the due tick, so it does not drift
+			WheelInsert(timerPt);
+		}
+		else{
+			TimerDisarm(timerPt);
+		}
+		timerPt->Runs++;
+		EndCritical(sr); // the task may be interrupted, and may cancel timers
+		TRACE(TRACE_TIMER_ENTER, TRACE_ISR, TRACEADDR(timerPt));
+		(*timerPt->Task)();
+		TRACE(TRACE_TIMER_EXIT, TRACE_ISR, TRACEADDR(timerPt));
+		sr = StartCritical();
+	}
+	EndCritical(sr);
+	OS_IsrExit();
+}
+#else
 void Timer1A_Handler(void){ 
+	OS_IsrEnter();
   TIMER1_ICR_R = TIMER_ICR_TATOCINT;// acknowledge timer1A timeout
+	TRACE(TRACE_TASK_ENTER, TRACE_ISR, 1);
 	(*PeriodicTask1)();
+	TRACE(TRACE_TASK_EXIT, TRACE_ISR, 1);
+	OS_IsrExit();
 }
+#endif
 
 void InitTimer2A(unsigned long period) {
 	long sr;
@@ -528,8 +3071,15 @@ void InitTimer2A(unsigned long period) {
   TIMER2_CTL_R &= ~TIMER_CTL_TAEN; // 1) disable timer2A during setup
                                    // 2) configure for 32-bit timer mode
   TIMER2_CFG_R = TIMER_CFG_32_BIT_TIMER;
+#ifdef tickless
+                                   // 3) configure for one-shot mode, default down-count settings
+  TIMER2_TAMR_R = TIMER_TAMR_TAMR_1_SHOT;
+  TickInterval = period/TIME_1MS;
+  TickPhase = 0;
+#else
                                    // 3) configure for periodic mode, default down-count settings
   TIMER2_TAMR_R = TIMER_TAMR_TAMR_PERIOD;
+#endif
   TIMER2_TAILR_R = period - 1;     // 4) reload value
                                    // 5) clear timer2A timeout flag
   TIMER2_ICR_R = TIMER_ICR_TATOCINT;
@@ -544,21 +3094,49 @@ void InitTimer2A(unsigned long period) {
 }
 
 void Timer2A_Handler(void){ 
+	long sr;
+#if (defined(aging) && !defined(lazyAging)) || !defined(sleepQueue)
 	int i;
+#endif
+#ifdef tickProfile
+	unsigned long startTime = OS_Time();
+	unsigned long elapsed;
+#endif
 	
+	OS_IsrEnter();
 	TIMER2_ICR_R = TIMER_ICR_TATOCINT;// acknowledge timer2A timeout
+	sr = StartCritical(); // Producer and button ISRs also edit the thread lists
+#ifdef tickless
+	MSTime += TickInterval;
+	KernelMs += TickInterval;
+	SleepAdvance(TickInterval);
+	TickPhase = 0;
+	TickRestart();
+#else
 	MSTime++;
+	KernelMs++;
+#ifdef sleepQueue
+	SleepAdvance(1);
+#endif
+#endif
 	
+#if (defined(aging) && !defined(lazyAging)) || !defined(sleepQueue)
 	for(i = 0; i < NUMTHREADS; i++) {
-#ifdef aging
+#if defined(aging) && !defined(lazyAging)
 		if (!tcbs[i].available) { // find threads that is in using
+#if defined(sleepQueue)
+			if ((tcbs[i].sleepCt == 0) && (tcbs[i].blockPt == 0)){  // threads that are ready
+				tcbs[i].age++;
+			}
+#else
 			if (tcbs[i].sleepCt){  // sleeping threads
 				tcbs[i].sleepCt -= 1;
 			}
 			else if (tcbs[i].blockPt == 0){  // threads that is not blocked
 				tcbs[i].age++;
 			}
-			if ((tcbs[i].age > 8) && (tcbs[i].WorkPriority > 0)){ 
+#endif
+			if ((tcbs[i].age > 8) && AGES(&tcbs[i])){ 
 				tcbs[i].age = 0;
 				tcbs[i].WorkPriority -= 1;
 			}
@@ -566,9 +3144,25 @@ void Timer2A_Handler(void){
 #else
 		if((!tcbs[i].available) && tcbs[i].sleepCt) {
 			tcbs[i].sleepCt -= 1;
+#ifdef readyQueue
+			if (tcbs[i].sleepCt == 0){
+				ReadyInsert(&tcbs[i]);
+			}
+#endif
 		}
 #endif
 	}
+#endif
+	EndCritical(sr);
+	OS_IsrExit();
+#ifdef tickProfile
+	elapsed = OS_TimeDifference(startTime, OS_Time());
+	if (elapsed > TickMaxTime){
+		TickMaxTime = elapsed;
+	}
+	TickTotalTime += elapsed;
+	TickCount++;
+#endif
 }
 
 void InitTimer3A(void) {
@@ -583,7 +3177,7 @@ void InitTimer3A(void) {
   TIMER3_CFG_R = TIMER_CFG_32_BIT_TIMER;
                                    // 3) configure for periodic mode, default down-count settings
   TIMER3_TAMR_R = TIMER_TAMR_TAMR_PERIOD;
-  TIMER3_TAILR_R = 0xFFFFFFFF - 1;     // 4) reload value
+  TIMER3_TAILR_R = 0xFFFFFFFF;     // 4) reload value, OS_Time() wraps like a 32-bit number
                                    // 5) clear timer3A timeout flag
   TIMER3_ICR_R = TIMER_ICR_TATOCINT;
   TIMER3_IMR_R |= TIMER_IMR_TATOIM;// 6) arm timeout interrupt
@@ -597,7 +3191,8 @@ void InitTimer3A(void) {
 }
 
 void Timer3A_Handler(void){ 
-  TIMER3_ICR_R = TIMER_ICR_TATOCINT;// acknowledge timer1A timeout	
+  TIMER3_ICR_R = TIMER_ICR_TATOCINT;// acknowledge timer3A timeout	
+	TimeHigh++;                       // OS_Time64() upper half
 }
 
 void InitTimer4A(uint32_t period, uint32_t priority) {
@@ -627,8 +3222,12 @@ void InitTimer4A(uint32_t period, uint32_t priority) {
 }
 
 void Timer4A_Handler(void){ 
+	OS_IsrEnter();
   TIMER4_ICR_R = TIMER_ICR_TATOCINT;// acknowledge timer4A timeout
+	TRACE(TRACE_TASK_ENTER, TRACE_ISR, 2);
 	(*PeriodicTask2)();
+	TRACE(TRACE_TASK_EXIT, TRACE_ISR, 2);
+	OS_IsrExit();
 }
 
 // Switch Tasks ------------------------------------------------------------------------
@@ -698,21 +3297,22 @@ void static DebouncePD7(void) {
 }
 
 void GPIOPortD_Handler(void) {  // called on touch of either SW1 or SW2
-
+	OS_IsrEnter();
 	if(GPIO_PORTD_RIS_R & 0x40){   // BUTTON1 touched
 		GPIO_PORTD_IM_R &= ~0x40;  //disarm interrupt on PD6
 		if (Last1){
 			(*ButtonOneTask)();
 		}
-		OS_AddThread(DebouncePD6,128,2);
+		OS_AddThread(DebouncePD6,256,2);
 	}
 	else if(GPIO_PORTD_RIS_R & 0x80){  // BUTTON2 touched
 		GPIO_PORTD_IM_R &= ~0x80;  //disarm interrupt on PD7
 		if (Last2){
 			(*ButtonTwoTask)();
 		}
-		OS_AddThread(DebouncePD7,128,2);
+		OS_AddThread(DebouncePD7,256,2);
 	}
+	OS_IsrExit();
 }
 
 //******** OS_AddSW1Task *************** 
@@ -10,6 +10,7 @@
  
 #ifndef _OS_H_
 #define _OS_H_
+#include "critical.h"
 
 // NVIC Defines
 #define NVIC_ST_CTRL_R          (*((volatile uint32_t *)0xE000E010))
@@ -46,12 +47,130 @@
 #define TIME_250US  (TIME_1MS/5)  
 
 // feel free to change the type of semaphore, there are lots of good solutions
+struct tcb;
+
+// semaStats gives every semaphore and mutex the Stats counters below. It is
+// set here and not in os.c with the other switches because it changes the
+// size of Sema4Type and MutexType, which every file that uses them must agree on
+#define semaStats
+
+// contention counters of one semaphore or mutex, kept with semaStats
+// OS_InitSemaphore and OS_InitMutex link them into the list OS_NextLock walks
+// so a semaphore or mutex that has been initialized must never go out of scope
+struct LockStats{
+  const char *Name;            // from OS_NameSemaphore or OS_NameMutex, 0 if not named
+  unsigned long Acquisitions;  // waits, tries and locks that took it
+  unsigned long Contended;     // of those, the ones that found it busy and waited
+  unsigned long Failed;        // OS_bTry calls and timed waits that did not take it
+  unsigned long WaitMax;       // longest wait, 12.5ns units
+  uint64_t WaitTotal;          // time spent waiting by all threads, 12.5ns units
+  struct LockStats *Next;      // next semaphore or mutex, 0 at the end
+};
+typedef struct LockStats LockStatsType;
+
 struct  Sema4{
   long Value;   // >0 means free, otherwise means busy        
-// add other components here, if necessary to implement blocking
+  struct tcb *BlockedList; // threads blocked here, highest priority first, FIFO within a priority
+  unsigned long Timeouts;  // OS_WaitTimeout and OS_bWaitTimeout calls that gave up
+#ifdef semaStats
+  LockStatsType Stats;     // contention counters
+#endif
 };
 typedef struct Sema4 Sema4Type;
 
+// mutex with an owner, priority inheritance and hold time statistics
+struct Mutex{
+  struct tcb *Owner;        // thread holding the mutex (0 if free)
+  struct tcb *BlockedList;  // threads waiting, highest priority first
+  struct Mutex *NextHeld;   // next mutex held by the same owner
+  unsigned long LockTime;   // OS_Time() when the owner took it
+  unsigned long MaxHold;    // longest time held, in 12.5ns units
+  unsigned long Inherits;   // times a waiter raised the priority of an owner
+  unsigned long BadUnlocks; // OS_MutexUnlock calls by a thread that did not own it
+#ifdef semaStats
+  LockStatsType Stats;      // contention counters
+#endif
+};
+typedef struct Mutex MutexType;
+
+// group of 32 event flags that threads can wait on
+struct EventFlags{
+  uint32_t Flags;           // current value of the flags
+  struct tcb *BlockedList;  // threads waiting, highest priority first
+};
+typedef struct EventFlags EventFlagsType;
+
+// queue of fixed size messages copied in and out, the buffer is given by the caller
+struct MsgQueue{
+  uint8_t *Buffer;          // Depth messages of MsgSize bytes
+  unsigned long MsgSize;    // bytes per message
+  unsigned long Depth;      // messages the buffer holds
+  unsigned long Count;      // messages in the buffer
+  unsigned long GetI;       // index of the oldest message
+  struct tcb *SendList;     // threads waiting for room, highest priority first
+  struct tcb *RecvList;     // threads waiting for a message, highest priority first
+  unsigned long Sent;       // messages accepted
+  unsigned long Full;       // sends that found no room and did not wait
+  unsigned long Timeouts;   // sends and receives that gave up waiting
+};
+typedef struct MsgQueue MsgQueueType;
+
+// pool of equal size blocks carved from a buffer given by the caller
+struct MemPool{
+  void *FreeList;           // free blocks, each holds the address of the next one in its first word
+  unsigned long BlockSize;  // bytes per block
+  unsigned long Blocks;     // blocks in the buffer
+  unsigned long Free;       // blocks on FreeList
+  unsigned long MinFree;    // fewest free blocks so far
+  unsigned long Empty;      // allocations that found no block and did not wait
+  unsigned long Timeouts;   // allocations that gave up waiting
+  struct tcb *WaitList;     // threads waiting for a block, highest priority first
+};
+typedef struct MemPool MemPoolType;
+
+#define OS_NO_WAIT      0           // timeout: fail at once instead of waiting
+#define OS_WAIT_FOREVER 0xFFFFFFFF  // timeout: wait until it succeeds
+
+// background task run from the timer wheel, periodic or one-shot
+struct Timer{
+  struct Timer *Next;       // next timer in the same wheel slot
+  struct Timer **Link;      // pointer that points to this timer, for O(1) removal
+  void (*Task)(void);       // background function, same rules as OS_AddPeriodicThread
+  uint32_t Expires;         // wheel tick of the next call
+  uint32_t Period;          // wheel ticks between calls, 0 for one-shot
+  uint32_t Priority;        // tasks due in the same tick run 0 (highest) first
+  uint32_t Active;          // 1 while the timer is on the wheel
+  uint32_t Runs;            // number of calls
+};
+typedef struct Timer TimerType;
+
+#define OS_TIMERTICK  (TIME_1MS/10)  // timer wheel resolution, 100us
+
+// state of OS_Debounce, start it at zero
+struct Debounce{
+  uint64_t Last;            // OS_Time64() of the last accepted event
+  unsigned long Accepted;   // events let through
+  unsigned long Rejected;   // events that came within the holdoff
+};
+typedef struct Debounce DebounceType;
+
+// CPU time used by one thread, filled in by OS_GetThreadStats
+struct ThreadStats{
+  unsigned long Id;         // thread ID
+  void (*Task)(void);       // entry point given to OS_AddThread
+  unsigned long Priority;   // priority given to OS_AddThread
+  unsigned long ExecCount;  // number of times switched to
+  uint64_t RunTime;         // 12.5ns units spent running, interrupts excluded
+  uint64_t IsrTime;         // 12.5ns units of interrupts that ran on top of it
+  unsigned long DeadlineMisses; // jobs of a deadline thread that ended late or never ran
+  unsigned long BudgetOverruns; // jobs of a deadline thread that used more than their wcet
+};
+typedef struct ThreadStats ThreadStatsType;
+
+#define OS_FLAGS_ANY    0   // wake when any flag in the mask is set
+#define OS_FLAGS_ALL    1   // wake when every flag in the mask is set
+#define OS_FLAGS_CLEAR  2   // clear the flags that ended the wait
+
 // ******** OS_Init ************
 // initialize operating system, disable interrupts until OS_Launch
 // initialize OS controlled I/O: serial, ADC, systick, LaunchPad I/O and timers 
@@ -87,27 +206,256 @@ void OS_bWait(Sema4Type *semaPt);
 // output: none
 void OS_bSignal(Sema4Type *semaPt);
 
+// ******** OS_WaitTimeout ************
+// decrement a counting semaphore, giving up after timeout ms
+// input:  pointer to a counting semaphore, ms to wait, OS_NO_WAIT or OS_WAIT_FOREVER
+// output: 1 if the semaphore was taken, 0 if the time ran out
+// every timeout is counted in Timeouts of the semaphore
+int OS_WaitTimeout(Sema4Type *semaPt, unsigned long timeout);
+
+// ******** OS_bWaitTimeout ************
+// take a binary semaphore, giving up after timeout ms
+// input:  pointer to a binary semaphore, ms to wait, OS_NO_WAIT or OS_WAIT_FOREVER
+// output: 1 if the semaphore was taken, 0 if the time ran out
+int OS_bWaitTimeout(Sema4Type *semaPt, unsigned long timeout);
+
 // ******** OS_bTry *************
 // input:  pointer to a binary semaphore
 // output: 1 if succesful, 0 if not
 uint16_t OS_bTry(Sema4Type *semaPt);
 
+// ******** OS_InitMutex ************
+// initialize a free mutex and clear its statistics
+// input:  pointer to a mutex
+// output: none
+void OS_InitMutex(MutexType *mutexPt);
+
+// ******** OS_MutexLock ************
+// take a mutex, blocking until it is free
+// the owner inherits the priority of higher priority waiters
+// input:  pointer to a mutex
+// output: none
+void OS_MutexLock(MutexType *mutexPt);
+
+// ******** OS_MutexUnlock ************
+// release a mutex held by the running thread
+// input:  pointer to a mutex
+// output: none
+// a call by a thread that does not own the mutex only counts BadUnlocks
+void OS_MutexUnlock(MutexType *mutexPt);
+
+// ******** OS_NameSemaphore ************
+// ******** OS_NameMutex ************
+// give a semaphore or mutex a name for OS_NextLock, kept by its Init function
+// input:  pointer to the semaphore or mutex, string that is never freed
+// output: none
+void OS_NameSemaphore(Sema4Type *semaPt, const char *name);
+void OS_NameMutex(MutexType *mutexPt, const char *name);
+
+// ******** OS_NextLock ************
+// walk the counters of every initialized semaphore and mutex
+// input:  0 for the first one, or the previous result
+// output: the next counters, 0 after the last one or without semaStats
+// the list only grows, so it can be walked with interrupts enabled
+LockStatsType *OS_NextLock(LockStatsType *statsPt);
+
+// ******** OS_ClearLockStats ************
+// zero the counters of every semaphore and mutex, names are kept
+// input:  none
+// output: none
+void OS_ClearLockStats(void);
+
+// ******** OS_InitEventFlags ************
+// initialize an event flag group
+// input:  pointer to the group, initial value of the 32 flags
+// output: none
+void OS_InitEventFlags(EventFlagsType *eventPt, uint32_t flags);
+
+// ******** OS_SetEventFlags ************
+// set flags in a group and wake every thread whose wait is now satisfied
+// input:  pointer to the group, flags to set
+// output: none
+// can be called from background tasks
+void OS_SetEventFlags(EventFlagsType *eventPt, uint32_t flags);
+
+// ******** OS_ClearEventFlags ************
+// clear flags in a group
+// input:  pointer to the group, flags to clear
+// output: none
+// can be called from background tasks
+void OS_ClearEventFlags(EventFlagsType *eventPt, uint32_t flags);
+
+// ******** OS_WaitEventFlags ************
+// block until any or all of the flags in mask are set
+// input:  pointer to the group, flags to wait for,
+//         OS_FLAGS_ANY or OS_FLAGS_ALL, plus OS_FLAGS_CLEAR to consume them
+// output: the flags in mask that were set when the wait ended
+uint32_t OS_WaitEventFlags(EventFlagsType *eventPt, uint32_t mask, uint32_t mode);
+
+// ******** OS_Notify ************
+// set bits in the notification word of a thread and wake it if it waits for one of them
+// input:  id of the thread from OS_Id, bits to set
+// output: 1 if the thread exists, 0 if not
+// can be called from background tasks and interrupts
+// an id is never given to two threads, a killed thread's id returns 0
+int OS_Notify(unsigned long id, uint32_t bits);
+
+// ******** OS_NotifyWait ************
+// take the bits of mask out of the notification word of the calling thread,
+// waiting for at least one of them to be set
+// input:  bits to wait for, ms to wait, OS_NO_WAIT or OS_WAIT_FOREVER
+// output: the bits of mask that were set, 0 if none were set in time
+uint32_t OS_NotifyWait(uint32_t mask, unsigned long timeout);
+
+// ******** OS_InitMsgQueue ************
+// initialize an empty message queue
+// input:  pointer to the queue, buffer of msgSize*depth bytes,
+//         bytes per message, number of messages
+// output: none
+void OS_InitMsgQueue(MsgQueueType *queuePt, void *buffer, unsigned long msgSize, unsigned long depth);
+
+// ******** OS_MsgSend ************
+// copy a message into a queue, or straight to the thread waiting for one
+// input:  pointer to the queue, message of MsgSize bytes,
+//         ms to wait for room, OS_NO_WAIT or OS_WAIT_FOREVER
+// output: 1 if sent, 0 if the queue stayed full
+// with OS_NO_WAIT it can be called from background tasks and interrupts
+int OS_MsgSend(MsgQueueType *queuePt, const void *msg, unsigned long timeout);
+
+// ******** OS_MsgReceive ************
+// copy the oldest message out of a queue
+// input:  pointer to the queue, place for MsgSize bytes,
+//         ms to wait for a message, OS_NO_WAIT or OS_WAIT_FOREVER
+// output: 1 if a message was received, 0 if the queue stayed empty
+int OS_MsgReceive(MsgQueueType *queuePt, void *msg, unsigned long timeout);
+
+// ******** OS_MsgCount ************
+// number of messages in a queue
+// input:  pointer to the queue
+// output: 0 to Depth
+unsigned long OS_MsgCount(MsgQueueType *queuePt);
+
+// ******** OS_InitPool ************
+// split a buffer into a pool of free blocks
+// input:  pointer to the pool, word aligned buffer of blockSize*blocks bytes,
+//         bytes per block, a multiple of 4, number of blocks
+// output: none
+void OS_InitPool(MemPoolType *poolPt, void *buffer, unsigned long blockSize, unsigned long blocks);
+
+// ******** OS_PoolAlloc ************
+// take a block out of a pool
+// input:  pointer to the pool, ms to wait for a block, OS_NO_WAIT or OS_WAIT_FOREVER
+// output: the block, 0 if the pool stayed empty
+// with OS_NO_WAIT it can be called from background tasks and interrupts
+void *OS_PoolAlloc(MemPoolType *poolPt, unsigned long timeout);
+
+// ******** OS_PoolFree ************
+// give a block back, or straight to the thread waiting for one
+// input:  pointer to the pool, block from OS_PoolAlloc of the same pool
+// output: none
+// can be called from background tasks and interrupts
+void OS_PoolFree(MemPoolType *poolPt, void *block);
+
 //******** OS_AddThread *************** 
 // add a foregound thread to the scheduler
 // Inputs: pointer to a void/void foreground task
 //         number of bytes allocated for its stack
 //         priority, 0 is highest, 5 is the lowest
 // Outputs: 1 if successful, 0 if this thread can not be added
-// stack size must be divisable by 8 (aligned to double word boundary)
+// stack size is rounded up to a multiple of 8 (aligned to double word boundary)
+// and must leave room for the interrupts that run on top of the thread
+// with edfSched or rmSched in os.c priority 0 is kept for deadline threads
+// with idleThread in os.c priority 7 is kept for the idle thread, 6 is used instead
 int OS_AddThread(void(*task)(void), 
    unsigned long stackSize, unsigned long priority);
 
+//******** OS_AddDeadlineThread *************** 
+// add a periodic foreground thread whose deadline is the end of each period
+// needs edfSched (earliest deadline first) or rmSched (rate monotonic) in os.c
+// Each job ends with OS_WaitPeriod(). The thread is refused if the sum of
+// wcet/period over all deadline threads would pass 100% (edfSched) or the
+// Liu and Layland bound (rmSched).
+// Inputs: pointer to a void/void foreground task
+//         number of bytes allocated for its stack
+//         period in units of 12.5ns, rounded to ms
+//         worst case CPU time per period in units of 12.5ns
+// Outputs: 1 if successful, 0 if this thread can not be added
+int OS_AddDeadlineThread(void(*task)(void), unsigned long stackSize,
+   unsigned long period, unsigned long wcet);
+
 //******** OS_Id *************** 
 // returns the thread ID for the currently running thread
 // Inputs: none
 // Outputs: Thread ID, number greater than zero 
+// the low byte is the TCB index, the rest counts reuses of the TCB
 unsigned long OS_Id(void);
 
+//******** OS_IsrEnter *************** 
+// call first thing in an interrupt handler so its time is not charged to a thread
+// Inputs: none
+// Outputs: none
+void OS_IsrEnter(void);
+
+//******** OS_IsrExit *************** 
+// call last thing in an interrupt handler that called OS_IsrEnter
+// Inputs: none
+// Outputs: none
+void OS_IsrExit(void);
+
+//******** OS_GetThreadStats *************** 
+// snapshot of the CPU time used by each live thread
+// Inputs: array to fill, number of entries in it
+// Outputs: number of entries filled
+unsigned long OS_GetThreadStats(ThreadStatsType *stats, unsigned long max);
+
+//******** OS_CheckThreads *************** 
+// walk the ring of live threads and the free TCB list and check they agree
+// Inputs: none
+// Outputs: number of live threads, -1 if the ring or the free list is broken
+long OS_CheckThreads(void);
+
+//******** OS_StackUsage *************** 
+// high-water mark of a thread's stack, painted when the thread was added
+// Inputs: thread ID
+// Outputs: most bytes of the stack ever used, 0 if the ID is not a live thread
+unsigned long OS_StackUsage(unsigned long id);
+
+//******** OS_InitThreadPool *************** 
+// create the worker threads that run jobs given to OS_SubmitJob
+// Inputs: number of workers
+//         number of bytes allocated for each worker stack
+//         priority of the workers, 0 is highest
+// Outputs: number of workers created
+unsigned long OS_InitThreadPool(unsigned long workers, unsigned long stackSize, unsigned long priority);
+
+//******** OS_SubmitJob *************** 
+// queue a job for the next free pool worker
+// Inputs: function to run, it must return instead of calling OS_Kill
+//         argument passed to the function
+// Outputs: 1 if successful, 0 if the job queue is full
+// can be called from background tasks
+int OS_SubmitJob(void(*func)(void *), void *arg);
+
+//******** OS_AddTimer *************** 
+// start a periodic or one-shot background task on the timer wheel
+// Inputs: timer, owned by the caller until it is cancelled or has fired
+//         pointer to a void/void background function
+//         delay to the first call, in system time units (12.5ns)
+//         period between calls in system time units, 0 for one call
+//         priority 0 is the highest, 5 is the lowest
+// Outputs: 1 if successful, 0 if the timer is already running
+// times are rounded to OS_TIMERTICK, the delay to at least one tick
+// the task follows the same rules as one given to OS_AddPeriodicThread
+int OS_AddTimer(TimerType *timerPt, void(*task)(void), unsigned long delay,
+   unsigned long period, unsigned long priority);
+
+//******** OS_CancelTimer *************** 
+// stop a timer, it will not be called again
+// Inputs: timer
+// Outputs: none
+// can be called from background tasks, including the timer's own task
+void OS_CancelTimer(TimerType *timerPt);
+
 //******** OS_AddPeriodicThread *************** 
 // add a background periodic task
 // typically this function receives the highest priority
@@ -115,7 +463,8 @@ unsigned long OS_Id(void);
 //         period given in system time units (12.5ns)
 //         priority 0 is the highest, 5 is the lowest
 // Outputs: 1 if successful, 0 if this thread can not be added
-// You are free to select the time resolution for this function
+// The period is rounded to OS_TIMERTICK, tasks share one timer interrupt
+// and the ones due in the same tick run highest priority first
 // It is assumed that the user task will run to completion and return
 // This task can not spin, block, loop, sleep, or kill
 // This task can call OS_Signal  OS_bSignal	 OS_AddThread
@@ -154,10 +503,18 @@ int OS_AddSW2Task(void(*task)(void), unsigned long priority);
 // OS_Sleep(0) implements cooperative multitasking
 void OS_Sleep(unsigned long sleepTime); 
 
+// ******** OS_WaitPeriod ************
+// end the current job of a deadline thread and sleep until its next release
+// jobs that end after their deadline are counted in DeadlineMisses
+// input:  none
+// output: none
+void OS_WaitPeriod(void);
+
 // ******** OS_Kill ************
 // kill the currently running thread, release its TCB and stack
 // input:  none
 // output: none
+// each mutex it still holds goes to its first waiter, or becomes free
 void OS_Kill(void); 
 
 // ******** OS_Suspend ************
@@ -187,8 +544,24 @@ unsigned long OS_Time(void);
 //   this function and OS_Time have the same resolution and precision 
 unsigned long OS_TimeDifference(unsigned long start, unsigned long stop);
 
+// ******** OS_Time64 ************
+// return the time since OS_Init, never wraps and is never reset
+// Inputs:  none
+// Outputs: time in 12.5ns units
+// use it for time stamps that must not jump, OS_MsTime can be cleared
+uint64_t OS_Time64(void);
+
+// ******** OS_Debounce ************
+// accept an event only if the last accepted one is at least holdoff ago
+// Inputs:  debounce state, zero before the first event
+//          holdoff in 12.5ns units
+// Outputs: 1 if accepted, 0 if it came too soon
+// can be called from a button task or any interrupt
+int OS_Debounce(DebounceType *debouncePt, unsigned long holdoff);
+
 // ******** OS_ClearMsTime ************
 // sets the system time to zero (from Lab 1)
+// only OS_MsTime is affected, OS_Time64 keeps counting
 // Inputs:  none
 // Outputs: none
 // You are free to change how this works
@@ -208,8 +581,17 @@ unsigned long OS_MsTime(void);
 //         you may select the units of this parameter
 // Outputs: none (does not return)
 // It is ok to limit the range of theTimeSlice to match the 24-bit SysTick
+// with idleThread in os.c the idle thread is added last, after the threads of main
 void OS_Launch(unsigned long theTimeSlice);
 
+// ******** OS_CpuLoad ************
+// share of the CPU not spent in the idle thread, interrupts included
+// Inputs:  window in ms, rounded up to the 100ms slots the idle time is kept
+//          in, at most the last 5 s
+// Outputs: load in 0.1% units, 0 to 1000, over the slots finished so far
+//          0 before the first slot ends or without idleThread in os.c
+unsigned long OS_CpuLoad(unsigned long window);
+
 void OS_InitBuzzer(void);
 
 void OS_CreateSound(int frequency, int tempo);
@@ -32,7 +32,7 @@
         EXPORT  OS_DisableInterrupts
         EXPORT  OS_EnableInterrupts
         EXPORT  StartOS
-        EXPORT  SysTick_Handler
+        EXPORT  PendSV_Handler
 
 
 OS_DisableInterrupts
@@ -45,7 +45,9 @@ OS_EnableInterrupts
         BX      LR
 
     IMPORT  Scheduler
-SysTick_Handler                ; 1) Saves R0-R3,R12,LR,PC,PSR
+; Lowest priority exception, pended by SysTick_Handler at the end of a time
+; slice and by OS_Suspend, so it only ever interrupts a foreground thread
+PendSV_Handler                 ; 1) Saves R0-R3,R12,LR,PC,PSR
     CPSID   I                  ; 2) Prevent interrupt during switch
     PUSH    {R4-R11}           ; 3) Save remaining regs r4-11
     LDR     R0, =RunPt         ; 4) R0=pointer to RunPt, old thread
@@ -0,0 +1,118 @@
+// filename **********trace.c***********
+// Kernel event trace for the cube-crusher RTOS
+// Records go into a power-of-2 ring with interrupts disabled for a few
+// instructions. Trace_Drain empties the ring into the UART0 software
+// transmit FIFO without waiting, keeping its place inside a partly sent
+// record, so tracing never stalls the thread that produced the event.
+
+#include <stdint.h>
+#include "os.h"
+#include "UART.h"
+#include "trace.h"
+
+#define TRACESIZE       128         // records, must be a power of 2
+#define TRACEWIRESIZE   10          // bytes per record on the UART
+
+long StartCritical (void);    // previous I bit, disable interrupts
+void EndCritical(long sr);    // restore I bit to previous value
+
+traceRecordType TraceBuffer[TRACESIZE];
+uint32_t TracePutI;           // total records put, index is TracePutI & (TRACESIZE-1)
+uint32_t TraceGetI;           // total records taken by Trace_Drain
+uint32_t TraceDropped;        // records lost because the ring was full
+uint32_t TraceSent;           // records sent over UART0
+
+static uint8_t WireBuf[TRACEWIRESIZE]; // record being sent
+static uint8_t WireI = TRACEWIRESIZE;  // next byte of WireBuf to send
+
+// ******** Trace_Init ************
+// empty the trace buffer
+// Inputs: none
+// Outputs: none
+void Trace_Init(void){
+	long sr = StartCritical();
+	TracePutI = 0;
+	TraceGetI = 0;
+	TraceDropped = 0;
+	TraceSent = 0;
+	WireI = TRACEWIRESIZE;
+	EndCritical(sr);
+}
+
+// ******** Trace_Record ************
+// add one event to the trace buffer, callable from threads and interrupts
+// the event is dropped and counted in TraceDropped if the buffer is full
+// Inputs: event type, thread ID, argument
+// Outputs: none
+void Trace_Record(uint8_t type, uint8_t id, uint16_t arg){
+	traceRecordType *rec;
+	long sr = StartCritical();
+	if ((TracePutI - TraceGetI) >= TRACESIZE){
+		TraceDropped++;
+	}
+	else{
+		rec = &TraceBuffer[TracePutI & (TRACESIZE-1)];
+		rec->Time = OS_Time();
+		rec->Type = type;
+		rec->Id = id;
+		rec->Arg = arg;
+		TracePutI++;
+	}
+	EndCritical(sr);
+}
+
+// ******** WireFill ************
+// take the oldest record out of the ring and encode it into WireBuf
+// Inputs: none
+// Outputs: 1 if a record was taken, 0 if the ring is empty
+static int WireFill(void){
+	traceRecordType rec;
+	uint8_t sum;
+	int i;
+	long sr = StartCritical();
+	if (TraceGetI == TracePutI){
+		EndCritical(sr);
+		return 0;
+	}
+	rec = TraceBuffer[TraceGetI & (TRACESIZE-1)];
+	TraceGetI++;
+	EndCritical(sr);
+	WireBuf[0] = TRACE_SYNC;
+	WireBuf[1] = rec.Type;
+	WireBuf[2] = rec.Id;
+	WireBuf[3] = rec.Arg & 0xFF;
+	WireBuf[4] = rec.Arg >> 8;
+	WireBuf[5] = rec.Time & 0xFF;
+	WireBuf[6] = (rec.Time >> 8) & 0xFF;
+	WireBuf[7] = (rec.Time >> 16) & 0xFF;
+	WireBuf[8] = rec.Time >> 24;
+	sum = 0;
+	for (i = 1; i < 9; i++){
+		sum += WireBuf[i];
+	}
+	WireBuf[9] = sum;
+	WireI = 0;
+	return 1;
+}
+
+// ******** Trace_Drain ************
+// send buffered events over UART0 until its transmit FIFO is full
+// never waits, so it can be called from a low priority thread
+// Inputs: none
+// Outputs: number of bytes sent
+uint32_t Trace_Drain(void){
+	uint32_t sent = 0;
+	for (;;){
+		if (WireI == TRACEWIRESIZE){ // previous record is out, encode the next
+			if (WireFill() == 0){
+				return sent;
+			}
+			TraceSent++;
+		}
+		if (UART_TryOutChar(WireBuf[WireI]) == 0){
+			return sent; // resume from this byte next time
+		}
+		WireI++;
+		sent++;
+	}
+}
@@ -0,0 +1,61 @@
+// filename **********trace.h***********
+// Kernel event trace for the cube-crusher RTOS
+// Events are time stamped with OS_Time() into a RAM ring buffer and
+// drained a few bytes at a time over UART0. trace2chrome.py turns the
+// captured byte stream into a Chrome trace (chrome://tracing, Perfetto).
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+#include <stdint.h>
+
+// event types, the Type byte of a record
+#define TRACE_SWITCH      1   // Id = thread switched in, Arg = thread switched out
+#define TRACE_WAIT        2   // Id = thread, Arg = semaphore address bits 15-0
+#define TRACE_BLOCK       3   // Id = thread, Arg = semaphore, the wait did not succeed
+#define TRACE_SIGNAL      4   // Id = thread or TRACE_ISR, Arg = semaphore
+#define TRACE_ADD         5   // Id = new thread, Arg = priority
+#define TRACE_KILL        6   // Id = thread that killed itself, Arg = 1 if stopped for a stack overflow
+#define TRACE_TASK_ENTER  7   // Id = TRACE_ISR, Arg = periodic task number
+#define TRACE_TASK_EXIT   8   // Id = TRACE_ISR, Arg = periodic task number
+#define TRACE_TIMER_ENTER 9   // Id = TRACE_ISR, Arg = timer address bits 15-0, a timer wheel task
+#define TRACE_TIMER_EXIT  10  // Id = TRACE_ISR, Arg = timer address bits 15-0
+
+#define TRACE_ISR       0xFF  // Id used for events raised by an interrupt handler
+
+// one record, 8 bytes in RAM
+struct traceRecord{
+  uint32_t Time;      // OS_Time(), 12.5ns units
+  uint8_t Type;       // TRACE_xxx
+  uint8_t Id;         // low byte of the thread ID (the TCB index) or TRACE_ISR
+  uint16_t Arg;       // meaning depends on Type
+};
+typedef struct traceRecord traceRecordType;
+
+// on the wire each record is sent as 10 bytes
+// TRACE_SYNC, Type, Id, Arg (little endian), Time (little endian), checksum
+// the checksum is the low 8 bits of the sum of the 8 bytes after TRACE_SYNC
+#define TRACE_SYNC      0xA5
+
+extern uint32_t TraceDropped;   // records lost because the ring was full
+
+// ******** Trace_Init ************
+// empty the trace buffer
+// Inputs: none
+// Outputs: none
+void Trace_Init(void);
+
+// ******** Trace_Record ************
+// add one event to the trace buffer, callable from threads and interrupts
+// the event is dropped and counted in TraceDropped if the buffer is full
+// Inputs: event type, thread ID, argument
+// Outputs: none
+void Trace_Record(uint8_t type, uint8_t id, uint16_t arg);
+
+// ******** Trace_Drain ************
+// send buffered events over UART0 until its transmit FIFO is full
+// never waits, so it can be called from a low priority thread
+// Inputs: none
+// Outputs: number of bytes sent
+uint32_t Trace_Drain(void);
+
+#endif
@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+# trace2chrome.py
+# Convert the kernel trace sent by Trace_Drain() (trace.c) over UART0 into
+# Chrome trace JSON. Open the output in chrome://tracing or ui.perfetto.dev.
+#
+# Capture the raw bytes first, for example
+#   stty -F /dev/ttyACM0 115200 raw && cat /dev/ttyACM0 > trace.bin
+# then
+#   python3 trace2chrome.py trace.bin trace.json
+#
+# Each record is 10 bytes: 0xA5, type, id, arg (2 bytes, little endian),
+# OS_Time() (4 bytes, little endian, 12.5ns units), checksum (low 8 bits of
+# the sum of the 8 bytes after 0xA5). Bytes that do not form a valid record
+# are skipped, so a capture may start in the middle of a record.
+
+import json
+import struct
+import sys
+
+SYNC = 0xA5
+RECORDSIZE = 10
+NS_PER_TICK = 12.5
+TIMER_PERIOD = 1 << 32  # Timer3 counts through every 32-bit value, so OS_Time() wraps here
+
+TRACE_SWITCH = 1
+TRACE_WAIT = 2
+TRACE_BLOCK = 3
+TRACE_SIGNAL = 4
+TRACE_ADD = 5
+TRACE_KILL = 6
+TRACE_TASK_ENTER = 7
+TRACE_TASK_EXIT = 8
+TRACE_TIMER_ENTER = 9
+TRACE_TIMER_EXIT = 10
+TRACE_ISR = 0xFF
+
+NAMES = {
+    TRACE_WAIT: "wait",
+    TRACE_BLOCK: "block",
+    TRACE_SIGNAL: "signal",
+    TRACE_ADD: "add thread",
+    TRACE_KILL: "kill",
+}
+
+
+def records(data):
+    """Yield (type, id, arg, time) for every valid record in data."""
+    i = 0
+    while i + RECORDSIZE <= len(data):
+        if data[i] != SYNC:
+            i += 1
+            continue
+        body = data[i + 1:i + 9]
+        if (sum(body) & 0xFF) != data[i + 9] or not 1 <= body[0] <= TRACE_TIMER_EXIT:
+            i += 1
+            continue
+        kind, tid, arg, time = struct.unpack("<BBHI", body)
+        yield kind, tid, arg, time
+        i += RECORDSIZE
+
+
+def convert(data):
+    events = []
+    offset = 0
+    last = None
+    running = None  # (thread id, start time in us)
+
+    for kind, tid, arg, time in records(data):
+        if last is not None and time < last:  # OS_Time() wrapped
+            offset += TIMER_PERIOD
+        last = time
+        us = (time + offset) * NS_PER_TICK / 1000.0
+        if kind == TRACE_SWITCH:
+            if running is not None:
+                start_tid, start = running
+                events.append({"name": "thread %d" % start_tid, "ph": "X", "pid": 0,
+                               "tid": start_tid, "ts": start, "dur": us - start})
+            running = (tid, us)
+        elif kind == TRACE_TASK_ENTER:
+            events.append({"name": "periodic task %d" % arg, "ph": "B", "pid": 0,
+                           "tid": TRACE_ISR, "ts": us})
+        elif kind == TRACE_TASK_EXIT:
+            events.append({"name": "periodic task %d" % arg, "ph": "E", "pid": 0,
+                           "tid": TRACE_ISR, "ts": us})
+        elif kind == TRACE_TIMER_ENTER:
+            events.append({"name": "timer 0x2000%04X" % arg, "ph": "B", "pid": 0,
+                           "tid": TRACE_ISR, "ts": us})
+        elif kind == TRACE_TIMER_EXIT:
+            events.append({"name": "timer 0x2000%04X" % arg, "ph": "E", "pid": 0,
+                           "tid": TRACE_ISR, "ts": us})
+        else:
+            name = NAMES[kind]
+            if kind == TRACE_ADD:
+                args = {"priority": arg}
+            elif kind == TRACE_KILL:
+                args = {"stack overflow": 1} if arg else {}
+            else:
+                args = {"sema": "0x2000%04X" % arg}
+            events.append({"name": name, "ph": "i", "s": "t", "pid": 0,
+                           "tid": tid, "ts": us, "args": args})
+    events.append({"name": "process_name", "ph": "M", "pid": 0,
+                   "args": {"name": "cube-crusher"}})
+    events.append({"name": "thread_name", "ph": "M", "pid": 0, "tid": TRACE_ISR,
+                   "args": {"name": "interrupts"}})
+    return {"traceEvents": events, "displayTimeUnit": "ns"}
+
+
+def main(argv):
+    if len(argv) != 3:
+        sys.stderr.write("usage: trace2chrome.py trace.bin trace.json\n")
+        return 1
+    with open(argv[1], "rb") as f:
+        data = f.read()
+    trace = convert(data)
+    with open(argv[2], "w") as f:
+        json.dump(trace, f)
+    sys.stderr.write("%d events\n" % len(trace["traceEvents"]))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))